@@ -0,0 +1,108 @@
+/* batch.c
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "batch.h"
+
+typedef struct NlexBatch {
+	NlexScanner         scan;
+	NlexBatchInput    * inputs;
+	size_t              n;
+	const NlexHandle  * proto;
+
+	size_t              next;       /* Next input to take; atomic */
+	size_t              incomplete; /* Atomic */
+} NlexBatch;
+
+/* Lexes one input to its end; returns whether all of it went into tokens */
+static _Bool nlex_batch_lex_one(NlexBatch * b, NlexHandle * nh, NlexBatchInput * in)
+{
+	nlex_reset(nh, NULL, in->buf);
+	nh->userdata = in->userdata;
+
+	for(;;) {
+		b->scan(nh);
+
+		if(nh->curtoklen == 0 || nlex_end_of_input(nh))
+			break;
+	}
+
+	/* A failed scan starts at the nullchar if everything else was taken. */
+	return nlex_end_of_input(nh) ||
+		(nh->curtokpos >= 0 && nh->buf[nh->curtokpos] == '\0');
+}
+
+static void * nlex_batch_worker(void * arg)
+{
+	NlexBatch  * b  = arg;
+	NlexHandle * nh = nlex_handle_new();
+
+	if(!nh)
+		nlex_die("nlex_handle_new() returned NULL.");
+
+	nlex_init(nh, NULL, NULL);
+
+	if(b->proto) {
+		nh->on_error       = b->proto->on_error? b->proto->on_error: nh->on_error;
+		nh->on_consume     = b->proto->on_consume;
+		nh->buf_alloc_unit = b->proto->buf_alloc_unit;
+		nh->par_nthreads   = b->proto->par_nthreads;
+		nh->par_min_chunk  = b->proto->par_min_chunk;
+	}
+
+	for(;;) {
+		size_t i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED);
+		if(i >= b->n)
+			break;
+
+		NlexBatchInput * in = &b->inputs[i];
+
+		in->complete = nlex_batch_lex_one(b, nh, in);
+		if(!in->complete)
+			__atomic_fetch_add(&b->incomplete, 1, __ATOMIC_RELAXED);
+	}
+
+	nlex_destroy(nh);
+	return NULL;
+}
+
+size_t nlex_lex_batch(NlexScanner scan, NlexBatchInput * inputs, size_t n,
+	size_t nthreads, const NlexHandle * proto)
+{
+	NlexBatch b = {
+		.scan = scan, .inputs = inputs, .n = n, .proto = proto,
+		.next = 0, .incomplete = 0
+	};
+
+	if(nthreads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpus > 0)? (size_t) ncpus: 1;
+	}
+
+	if(nthreads > n)
+		nthreads = n;
+
+	/* The calling thread is one of the workers. */
+	pthread_t * threads = nlex_calloc_internal(nthreads? nthreads: 1, sizeof(pthread_t));
+	_Bool     * started = nlex_calloc_internal(nthreads? nthreads: 1, sizeof(_Bool));
+
+	for(size_t k = 1; k < nthreads; k++)
+		started[k] = (0 == pthread_create(&threads[k], NULL, nlex_batch_worker, &b));
+
+	if(n)
+		nlex_batch_worker(&b);
+
+	for(size_t k = 1; k < nthreads; k++)
+		if(started[k])
+			pthread_join(threads[k], NULL);
+
+	free(threads);
+	free(started);
+
+	return b.incomplete;
+}
@@ -0,0 +1,40 @@
+/* batch.h
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+/* Lexing of many independent strings on a pool of threads, with a handle
+ * per thread that is reused from one input to the next (see nlex_reset()).
+ * The scanner has to be a function generated with --function, which keeps
+ * no state outside the handle it is given; its actions find the input
+ * they are working on through nh->userdata.
+ *
+ * Link with -pthread.
+ */
+
+#ifndef _N96E_LEX_BATCH_H
+#define _N96E_LEX_BATCH_H
+
+#include "read.h"
+
+/* A scanner generated with --function */
+typedef void (*NlexScanner)(NlexHandle * nh);
+
+typedef struct NlexBatchInput {
+	const char * buf;       /* NUL-terminated */
+	void       * userdata;  /* nh->userdata while buf is lexed */
+	_Bool        complete;  /* Set: false if lexing stopped at a byte no
+	                         * rule matches */
+} NlexBatchInput;
+
+/* Calls scan on each input until it is consumed or no rule matches, with
+ * up to nthreads threads (0 for one per online CPU). The callbacks and
+ * parameters of proto (which can be NULL) are given to every handle; the
+ * inputs are taken in order, but in no particular order across threads.
+ * Returns the number of inputs that are not complete.
+ */
+size_t nlex_lex_batch(NlexScanner scan, NlexBatchInput * inputs, size_t n,
+	size_t nthreads, const NlexHandle * proto);
+
+#endif
@@ -0,0 +1,1752 @@
+/* dfa.c
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "dfa.h"
+#include "error.h"
+#include "read.h"
+#include "tree.h"
+
+/* XXX Keep in sync with nan_character_print_c_comp() */
+bool nan_character_matches(NlexCharacter c, int ch)
+{
+	if(c < 0) {
+		if((-c & NLEX_CASE_ANYCHAR) && binary_input)
+			return (ch != EOF);
+		else if(-c & NLEX_CASE_ANYCHAR)
+			return (ch != 0 && ch != EOF);
+		else if(-c & NLEX_CASE_DIGIT)
+			return (ch >= 0 && isdigit(ch));
+		else if(-c & NLEX_CASE_LETTER)
+			return (ch >= 0 && isalpha(ch));
+		else if(-c & NLEX_CASE_EOF)
+			return (ch == EOF);
+		else if(-c & NLEX_CASE_WORDCHAR)
+			return (ch >= 0 && (isalpha(ch) || isdigit(ch) || ch == '_'));
+
+		return false;
+	}
+
+	/* A \xHH above 0x7F is compared as a char; see nan_byte_to_ch() */
+	return (ch == c || (!binary_input && ch < 0 && (unsigned char) ch == c));
+}
+
+static bool nan_treenode_matches_eof(const NanTreeNode * node)
+{
+	if(node->ch < 0 && (-(node->ch) & NLEX_CASE_LIST)) {
+		const NanCharacterList * ncl = nan_treenode_get_charlist(node);
+
+		/* Inverted lists never match EOF */
+		for(size_t i = 0; i < ncl->count; i++)
+			if(!(-(node->ch) & NLEX_CASE_INVERT) && nan_character_matches(ncl->list[i], EOF))
+				return true;
+
+		return false;
+	}
+
+	return nan_character_matches(node->ch, EOF);
+}
+
+/* XXX Keep in sync with nan_inode_to_code_matchbranch() */
+void nan_treenode_get_byteset(const NanTreeNode * node, NanByteSet * bs)
+{
+	memset(bs, 0, sizeof(NanByteSet));
+
+	for(unsigned int b = 0; b < NAN_DFA_NSYMS; b++) {
+		int  ch = nan_byte_to_ch(b);
+		bool matches = false;
+
+		if(node->ch < 0 && (-(node->ch) & NLEX_CASE_LIST)) {
+			NanCharacterList * ncl = nan_treenode_get_charlist(node);
+
+			for(size_t i = 0; i < ncl->count && !matches; i++)
+				matches = nan_character_matches(ncl->list[i], ch);
+
+			if((-(node->ch) & NLEX_CASE_INVERT) && binary_input)
+				matches = !matches;
+			else if(-(node->ch) & NLEX_CASE_INVERT)
+				matches = (ch != EOF && ch != 0 && !matches);
+		}
+		else {
+			matches = nan_character_matches(node->ch, ch);
+		}
+
+		if(matches)
+			nan_byte_set_add(bs, b);
+	}
+
+	/* The scanner stops at EOF instead of reading it. */
+	if(binary_input && nan_treenode_matches_eof(node))
+		nlex_die("\\Z cannot be used with --binary and the --dfa variants.");
+}
+
+static void nan_nfa_collect_states(NanNfa * nfa, NanTreeNode * node)
+{
+	if(node->visited)
+		return;
+	else
+		node->visited = true;
+
+	if(node->ch == NLEX_CASE_ACT || node->ch == NLEX_CASE_FASTKWACT)
+		return;
+
+	if(nfa->count >= nfa->allocsiz) {
+		nfa->allocsiz = nfa->allocsiz? nfa->allocsiz * 2: 64;
+		nfa->states   = nlex_realloc(NULL, nfa->states,
+			sizeof(NanNfaState) * nfa->allocsiz);
+	}
+
+	NanNfaState * st = &(nfa->states[nfa->count++]);
+	memset(st, 0, sizeof(NanNfaState));
+	st->node = node;
+
+	for(NanTreeNode * chld = node->first_child; chld; chld = chld->sibling)
+		nan_nfa_collect_states(nfa, chld);
+}
+
+static inline size_t nan_nfa_index(const NanNfa * nfa, NanTreeNode * node)
+{
+	NanTreeNodeId id = nan_tree_node_id(node);
+
+	assert(id < nfa->index_of_id_len);
+	assert(nfa->index_of_id[id] != 0);
+
+	return nfa->index_of_id[id] - 1;
+}
+
+static void nan_nfa_state_add_succ(NanNfaState * st, size_t idx)
+{
+	if(st->nsucc >= st->succ_allocsiz) {
+		st->succ_allocsiz = st->succ_allocsiz? st->succ_allocsiz * 2: 4;
+		st->succ = nlex_realloc(NULL, st->succ,
+			sizeof(size_t) * st->succ_allocsiz);
+	}
+
+	st->succ[st->nsucc++] = idx;
+}
+
+static void nan_nfa_collect_inode(
+	NanNfa * nfa, NanNfaState * st, NanTreeNode * node, bool pseudonode);
+
+/* XXX The following three mirror nan_inode_to_code() and friends; the
+ * pushes of a state have to be exactly those of its `case` in the NFA
+ * code. The action it registers is node->acc (nan_tree_mark_accepts()).
+ */
+static void nan_nfa_collect_matchbranch(
+	NanNfa * nfa, NanNfaState * st, NanTreeNode * tptr)
+{
+	if(tptr->ch == NLEX_CASE_PASSTHRU) {
+		for(NanTreeNode * chld = tptr->first_child; chld; chld = chld->sibling)
+			nan_nfa_collect_matchbranch(nfa, st, chld);
+
+		return;
+	}
+
+	nan_nfa_state_add_succ(st, nan_nfa_index(nfa, tptr));
+}
+
+static void nan_nfa_collect_kleene_skipping(
+	NanNfa * nfa, NanNfaState * st, NanTreeNode * node)
+{
+	for(NanTreeNode * tptr = node->first_child; tptr; tptr = tptr->sibling) {
+		if(tptr->ch == NLEX_CASE_PASSTHRU)
+			nan_nfa_collect_kleene_skipping(nfa, st, tptr);
+
+		if(tptr->klnptr_from) {
+			size_t len = nan_tree_node_vector_get_count(tptr->klnptr_from);
+
+			for(size_t i = 0; i < len; i++) {
+				NanTreeNode * ni = nan_tree_node_vector_get_item(tptr->klnptr_from, i);
+				assert(ni);
+
+				nan_nfa_collect_inode(nfa, st, ni, true);
+			}
+		}
+	}
+}
+
+static void nan_nfa_collect_inode(
+	NanNfa * nfa, NanNfaState * st, NanTreeNode * node, bool pseudonode)
+{
+	NanTreeNode * tptr = NULL;
+
+	if(pseudonode) {
+		if(node->klnptr)
+			nan_nfa_collect_matchbranch(nfa, st, node->klnptr);
+	}
+	else if(node->klnptr) {
+		nan_nfa_collect_inode(nfa, st, node, true);
+		return;
+	}
+
+	nan_nfa_collect_kleene_skipping(nfa, st, node);
+
+	for(tptr = node->first_child; tptr; tptr = tptr->sibling) {
+		if(tptr->ch == NLEX_CASE_ACT || tptr->ch == NLEX_CASE_FASTKWACT)
+			continue;
+
+		if(nan_treenode_is_klndst(tptr))
+			continue;
+
+		nan_nfa_collect_matchbranch(nfa, st, tptr);
+	}
+}
+
+static int nan_size_cmp(const void * a, const void * b)
+{
+	size_t x = *((const size_t *) a);
+	size_t y = *((const size_t *) b);
+
+	return (x > y) - (x < y);
+}
+
+/* Sort and remove the duplicates (a state can be pushed multiple times) */
+static size_t nan_size_array_sort_unique(size_t * arr, size_t len)
+{
+	size_t n = 0;
+
+	qsort(arr, len, sizeof(size_t), nan_size_cmp);
+
+	for(size_t i = 0; i < len; i++)
+		if(n == 0 || arr[n - 1] != arr[i])
+			arr[n++] = arr[i];
+
+	return n;
+}
+
+void nan_nfa_construct(NanNfa * nfa, NanTreeNode * root)
+{
+	memset(nfa, 0, sizeof(NanNfa));
+
+	nan_tree_unvisit(root);
+	nan_nfa_collect_states(nfa, root);
+
+	NanTreeNodeId maxid = 0;
+	for(size_t i = 0; i < nfa->count; i++)
+		if(nan_tree_node_id(nfa->states[i].node) > maxid)
+			maxid = nan_tree_node_id(nfa->states[i].node);
+
+	nfa->index_of_id_len = (size_t) maxid + 1;
+	nfa->index_of_id     =
+		nlex_calloc_internal(nfa->index_of_id_len, sizeof(size_t));
+
+	for(size_t i = 0; i < nfa->count; i++)
+		nfa->index_of_id[nan_tree_node_id(nfa->states[i].node)] = i + 1;
+
+	for(size_t i = 0; i < nfa->count; i++) {
+		NanNfaState * st = &(nfa->states[i]);
+
+		nan_nfa_collect_inode(nfa, st, st->node, false);
+		st->nsucc = nan_size_array_sort_unique(st->succ, st->nsucc);
+		st->acc   = st->node->acc;
+
+		nan_treenode_get_byteset(st->node, &(st->chset));
+	}
+
+	nfa->start = nan_nfa_index(nfa, root);
+}
+
+void nan_nfa_destruct(NanNfa * nfa)
+{
+	for(size_t i = 0; i < nfa->count; i++)
+		free(nfa->states[i].succ);
+
+	free(nfa->states);
+	free(nfa->index_of_id);
+}
+
+bool nan_nfa_accepts(const NanNfa * nfa, const char * s)
+{
+	bool * live = nlex_calloc_internal(nfa->count, sizeof(bool));
+	bool * next = nlex_calloc_internal(nfa->count, sizeof(bool));
+	bool   any  = true;
+
+	live[nfa->start] = true;
+
+	for(; *s && any; s++) {
+		unsigned int b = (unsigned char) *s;
+
+		memset(next, 0, sizeof(bool) * nfa->count);
+		any = false;
+
+		for(size_t i = 0; i < nfa->count; i++) {
+			if(!live[i])
+				continue;
+
+			const NanNfaState * st = &(nfa->states[i]);
+
+			for(size_t k = 0; k < st->nsucc; k++) {
+				if(nan_byte_set_has(&(nfa->states[st->succ[k]].chset), b))
+					next[st->succ[k]] = any = true;
+			}
+		}
+
+		bool * tmp = live;
+		live = next;
+		next = tmp;
+	}
+
+	bool accepts = false;
+
+	for(size_t i = 0; any && i < nfa->count; i++)
+		if(live[i] && nfa->states[i].acc)
+			accepts = true;
+
+	free(live);
+	free(next);
+
+	return accepts;
+}
+
+/* Refine the partition by one chset at a time; two bytes stay together
+ * only if every state accepts both or neither.
+ */
+size_t nan_nfa_byte_classes(const NanNfa * nfa, uint8_t * classmap)
+{
+	size_t nclasses = 1;
+	size_t remap[NAN_DFA_NSYMS * 2];
+
+	memset(classmap, 0, NAN_DFA_NSYMS);
+
+	for(size_t i = 0; i < nfa->count && nclasses < NAN_DFA_NSYMS; i++) {
+		const NanByteSet * chset = &(nfa->states[i].chset);
+
+		for(size_t k = 0; k < nclasses * 2; k++)
+			remap[k] = SIZE_MAX;
+
+		nclasses = 0;
+
+		/* Renumbering in the order of the bytes keeps byte 0 in class 0
+		 * and numbers the classes by their least byte.
+		 */
+		for(unsigned int b = 0; b < NAN_DFA_NSYMS; b++) {
+			size_t k = (size_t) classmap[b] * 2 + nan_byte_set_has(chset, b);
+
+			if(remap[k] == SIZE_MAX)
+				remap[k] = nclasses++;
+
+			classmap[b] = remap[k];
+		}
+	}
+
+	return nclasses;
+}
+
+static size_t nan_dfa_set_hash(const size_t * items, size_t len)
+{
+	size_t h = 14695981039346656037UL;
+
+	for(size_t i = 0; i < len; i++) {
+		h ^= items[i];
+		h *= 1099511628211UL;
+	}
+
+	return h;
+}
+
+static NanDfaStateId nan_dfa_append_state(
+	NanDfa * dfa, const NanNfa * nfa, const size_t * items, size_t len, size_t hash)
+{
+	if(dfa->count >= dfa->allocsiz) {
+		dfa->allocsiz = dfa->allocsiz? dfa->allocsiz * 2: 64;
+		dfa->trans    = nlex_realloc(NULL, dfa->trans,
+			sizeof(NanDfaStateId) * dfa->nsyms * dfa->allocsiz);
+		dfa->acc      = nlex_realloc(NULL, dfa->acc,
+			sizeof(NanTreeNodeId) * dfa->allocsiz);
+		dfa->sets     = nlex_realloc(NULL, dfa->sets,
+			sizeof(NanDfaSet) * dfa->allocsiz);
+		dfa->fallback = nlex_realloc(NULL, dfa->fallback,
+			sizeof(bool) * dfa->allocsiz);
+	}
+
+	NanDfaStateId s = dfa->count++;
+
+	memset(dfa->trans + (size_t) s * dfa->nsyms, 0,
+		sizeof(NanDfaStateId) * dfa->nsyms);
+
+	dfa->sets[s].items = NULL;
+	dfa->sets[s].len   = len;
+	dfa->sets[s].hash  = hash;
+	dfa->fallback[s]   = false;
+
+	if(len) {
+		dfa->sets[s].items = nlex_malloc(NULL, sizeof(size_t) * len);
+		memcpy(dfa->sets[s].items, items, sizeof(size_t) * len);
+	}
+
+	/* The member with the least action id wins, as with
+	 * hiprio_act_this_iter in the NFA code.
+	 */
+	dfa->acc[s] = 0;
+	for(size_t i = 0; i < len; i++) {
+		NanTreeNodeId acc = nfa->states[items[i]].acc;
+
+		if(acc != 0 && (dfa->acc[s] == 0 || acc < dfa->acc[s]))
+			dfa->acc[s] = acc;
+	}
+
+	return s;
+}
+
+static void nan_dfa_rehash(NanDfa * dfa)
+{
+	free(dfa->slots);
+
+	dfa->nslots = dfa->nslots? dfa->nslots * 2: 256;
+	dfa->slots  = nlex_calloc_internal(dfa->nslots, sizeof(NanDfaStateId));
+
+	/* The dead state (0) is never looked up, so it is not stored. */
+	for(NanDfaStateId s = 1; s < dfa->count; s++) {
+		size_t slot = dfa->sets[s].hash & (dfa->nslots - 1);
+
+		while(dfa->slots[slot])
+			slot = (slot + 1) & (dfa->nslots - 1);
+
+		dfa->slots[slot] = s;
+	}
+}
+
+static NanDfaStateId nan_dfa_lookup_or_add(NanDfa * dfa,
+	const NanNfa * nfa, const size_t * items, size_t len, size_t max_states)
+{
+	if(len == 0)
+		return 0;
+
+	size_t hash = nan_dfa_set_hash(items, len);
+	size_t slot = hash & (dfa->nslots - 1);
+
+	while(dfa->slots[slot]) {
+		const NanDfaSet * set = &(dfa->sets[dfa->slots[slot]]);
+
+		if( set->hash == hash && set->len == len &&
+		    0 == memcmp(set->items, items, sizeof(size_t) * len) )
+		{
+			return dfa->slots[slot];
+		}
+
+		slot = (slot + 1) & (dfa->nslots - 1);
+	}
+
+	NanDfaStateId s = nan_dfa_append_state(dfa, nfa, items, len, hash);
+	dfa->slots[slot] = s;
+
+	/* The dead state does not count. */
+	if(max_states && s - 1 - dfa->nfallbacks >= max_states) {
+		dfa->fallback[s] = true;
+		dfa->nfallbacks++;
+	}
+
+	if(dfa->count * 2 > dfa->nslots)
+		nan_dfa_rehash(dfa);
+
+	return s;
+}
+
+/* Subset construction; DFA states are numbered in the order of discovery,
+ * so the start state is 1. Without equiv_classes, every byte is a class of
+ * its own. The states discovered after max_states are marked as fallback
+ * states and not expanded.
+ */
+void nan_dfa_construct(NanDfa * dfa, const NanNfa * nfa,
+	bool equiv_classes, size_t max_states)
+{
+	memset(dfa, 0, sizeof(NanDfa));
+
+	if(equiv_classes) {
+		dfa->nsyms = nan_nfa_byte_classes(nfa, dfa->classmap);
+	}
+	else {
+		for(unsigned int b = 0; b < NAN_DFA_NSYMS; b++)
+			dfa->classmap[b] = b;
+
+		dfa->nsyms = NAN_DFA_NSYMS;
+	}
+
+	/* Any byte of a class stands for all of it. */
+	unsigned int rep[NAN_DFA_NSYMS];
+	for(unsigned int b = NAN_DFA_NSYMS; b > 0; b--)
+		rep[dfa->classmap[b - 1]] = b - 1;
+
+	nan_dfa_rehash(dfa);
+	nan_dfa_append_state(dfa, nfa, NULL, 0, 0);
+
+	dfa->start = nan_dfa_lookup_or_add(dfa, nfa, &(nfa->start), 1, 0);
+
+	/* Rules like `.*` make the root accepting, but that would be a token of
+	 * zero length. No transition leads back to the start state.
+	 */
+	dfa->acc[dfa->start] = 0;
+
+	size_t * stamp   = nlex_calloc_internal(nfa->count, sizeof(size_t));
+	size_t * targets = nlex_malloc(NULL, sizeof(size_t) * (nfa->count + 1));
+	size_t * subset  = nlex_malloc(NULL, sizeof(size_t) * (nfa->count + 1));
+
+	for(NanDfaStateId s = 1; s < dfa->count; s++) {
+		if(dfa->fallback[s])
+			continue;
+
+		/* dfa->sets can be relocated while adding states below. */
+		const size_t * items = dfa->sets[s].items;
+		size_t         len   = dfa->sets[s].len;
+		size_t         ntargets = 0;
+
+		for(size_t i = 0; i < len; i++) {
+			const NanNfaState * st = &(nfa->states[items[i]]);
+
+			for(size_t j = 0; j < st->nsucc; j++) {
+				if(stamp[st->succ[j]] != s) {
+					stamp[st->succ[j]] = s;
+					targets[ntargets++] = st->succ[j];
+				}
+			}
+		}
+
+		qsort(targets, ntargets, sizeof(size_t), nan_size_cmp);
+
+		for(unsigned int sym = 0; sym < dfa->nsyms; sym++) {
+			size_t sublen = 0;
+
+			for(size_t i = 0; i < ntargets; i++)
+				if(nan_byte_set_has(&(nfa->states[targets[i]].chset), rep[sym]))
+					subset[sublen++] = targets[i];
+
+			NanDfaStateId t =
+				nan_dfa_lookup_or_add(dfa, nfa, subset, sublen, max_states);
+			dfa->trans[(size_t) s * dfa->nsyms + sym] = t;
+		}
+	}
+
+	free(stamp);
+	free(targets);
+	free(subset);
+}
+
+void nan_dfa_destruct(NanDfa * dfa)
+{
+	for(size_t s = 0; dfa->sets && s < dfa->count; s++)
+		free(dfa->sets[s].items);
+
+	free(dfa->sets);
+	free(dfa->trans);
+	free(dfa->acc);
+	free(dfa->slots);
+	free(dfa->fallback);
+}
+
+/* Refinable partition used by nan_dfa_minimize(); the elements of a block
+ * are elems[first[b]] to elems[end[b] - 1], and the marked ones are moved
+ * to the front of the block (up to mid[b]).
+ */
+typedef struct NanPartition {
+	NanDfaStateId * elems;
+	size_t        * loc;
+	size_t        * blk;
+	size_t        * first;
+	size_t        * mid;
+	size_t        * end;
+	size_t          nblocks;
+
+	size_t        * touched;
+	size_t          ntouched;
+} NanPartition;
+
+static void nan_partition_mark(NanPartition * p, NanDfaStateId e)
+{
+	size_t b = p->blk[e];
+	size_t i = p->loc[e];
+	size_t j = p->mid[b];
+
+	if(i < j)
+		return; /* Already marked */
+
+	p->elems[i] = p->elems[j];
+	p->loc[p->elems[i]] = i;
+	p->elems[j] = e;
+	p->loc[e] = j;
+
+	if(p->mid[b]++ == p->first[b])
+		p->touched[p->ntouched++] = b;
+}
+
+/* Split the touched blocks; the smaller half becomes the new block and is
+ * added to the worklist, which is what makes this Hopcroft's algorithm.
+ */
+static void nan_partition_split(
+	NanPartition * p, size_t * worklist, size_t * wlcount)
+{
+	while(p->ntouched) {
+		size_t b = p->touched[--(p->ntouched)];
+		size_t m = p->mid[b];
+
+		if(m == p->end[b]) {
+			p->mid[b] = p->first[b];
+			continue;
+		}
+
+		size_t nb = p->nblocks++;
+
+		if(m - p->first[b] <= p->end[b] - m) {
+			p->first[nb] = p->first[b];
+			p->end[nb]   = m;
+			p->first[b]  = m;
+		}
+		else {
+			p->first[nb] = m;
+			p->end[nb]   = p->end[b];
+			p->end[b]    = m;
+		}
+
+		p->mid[b]  = p->first[b];
+		p->mid[nb] = p->first[nb];
+
+		for(size_t i = p->first[nb]; i < p->end[nb]; i++)
+			p->blk[p->elems[i]] = nb;
+
+		worklist[(*wlcount)++] = nb;
+	}
+}
+
+/* Hopcroft's algorithm. States are first split by the action they select
+ * (the dead state goes with the non-accepting ones), so rule priorities are
+ * kept as they are; each fallback state is a block of its own. The dead
+ * state stays 0 and the start state stays 1 (unless no rule can be matched
+ * at all, making it dead).
+ * Only the NFA sets of the fallback states survive this (merged states
+ * have different sets).
+ */
+void nan_dfa_minimize(NanDfa * dfa)
+{
+	size_t n = dfa->count;
+	size_t nsyms = dfa->nsyms;
+
+	NanPartition p;
+	p.elems   = nlex_malloc(NULL, sizeof(NanDfaStateId) * n);
+	p.loc     = nlex_malloc(NULL, sizeof(size_t) * n);
+	p.blk     = nlex_malloc(NULL, sizeof(size_t) * n);
+	p.first   = nlex_malloc(NULL, sizeof(size_t) * n);
+	p.mid     = nlex_malloc(NULL, sizeof(size_t) * n);
+	p.end     = nlex_malloc(NULL, sizeof(size_t) * n);
+	p.touched = nlex_malloc(NULL, sizeof(size_t) * n);
+	p.nblocks  = 0;
+	p.ntouched = 0;
+
+	/* BEGIN Initial partition (counting sort by the action id) */
+	NanTreeNodeId maxacc = 0;
+	for(size_t s = 0; s < n; s++)
+		if(dfa->acc[s] > maxacc)
+			maxacc = dfa->acc[s];
+
+	size_t * accblk = nlex_malloc(NULL, sizeof(size_t) * ((size_t) maxacc + 1));
+	size_t * accpos = nlex_calloc_internal((size_t) maxacc + 1, sizeof(size_t));
+
+	for(size_t s = 0; s < n; s++)
+		accpos[dfa->acc[s]]++;
+
+	size_t pos = 0;
+	for(size_t a = 0; a <= maxacc; a++) {
+		size_t cnt = accpos[a];
+
+		accpos[a] = pos;
+
+		if(cnt) {
+			accblk[a] = p.nblocks;
+			p.first[p.nblocks] = pos;
+			p.mid[p.nblocks]   = pos;
+			p.end[p.nblocks]   = pos + cnt;
+			p.nblocks++;
+		}
+
+		pos += cnt;
+	}
+
+	for(size_t s = 0; s < n; s++) {
+		size_t i = accpos[dfa->acc[s]]++;
+
+		p.elems[i] = s;
+		p.loc[s]   = i;
+		p.blk[s]   = accblk[dfa->acc[s]];
+	}
+
+	free(accblk);
+	free(accpos);
+	/* END Initial partition */
+
+	/* BEGIN Inverse transitions, grouped by (target, symbol) */
+	size_t * predstart = nlex_calloc_internal(n * nsyms + 1, sizeof(size_t));
+	NanDfaStateId * preds = nlex_malloc(NULL, sizeof(NanDfaStateId) * n * nsyms);
+
+	for(size_t s = 0; s < n; s++)
+		for(size_t a = 0; a < nsyms; a++)
+			predstart[(size_t) nan_dfa_next(dfa, s, a) * nsyms + a + 1]++;
+
+	for(size_t i = 1; i <= n * nsyms; i++)
+		predstart[i] += predstart[i - 1];
+
+	size_t * predfill = nlex_malloc(NULL, sizeof(size_t) * n * nsyms);
+	memcpy(predfill, predstart, sizeof(size_t) * n * nsyms);
+
+	for(size_t s = 0; s < n; s++)
+		for(size_t a = 0; a < nsyms; a++)
+			preds[predfill[(size_t) nan_dfa_next(dfa, s, a) * nsyms + a]++] = s;
+
+	free(predfill);
+	/* END Inverse transitions */
+
+	/* Each block is added once, as it is made, so n slots are enough. */
+	size_t * worklist = nlex_malloc(NULL, sizeof(size_t) * n);
+	size_t   wlcount  = 0;
+
+	for(size_t b = 0; b < p.nblocks; b++)
+		worklist[wlcount++] = b;
+
+	for(size_t s = 0; s < n; s++) {
+		if(dfa->fallback[s]) {
+			nan_partition_mark(&p, s);
+			nan_partition_split(&p, worklist, &wlcount);
+		}
+	}
+
+	NanDfaStateId * splitter = nlex_malloc(NULL, sizeof(NanDfaStateId) * n);
+
+	while(wlcount) {
+		size_t b = worklist[--wlcount];
+
+		/* Marking moves elements around inside blocks, b included. */
+		size_t splen = p.end[b] - p.first[b];
+		memcpy(splitter, p.elems + p.first[b], sizeof(NanDfaStateId) * splen);
+
+		for(size_t a = 0; a < nsyms; a++) {
+			for(size_t i = 0; i < splen; i++) {
+				size_t k = (size_t) splitter[i] * nsyms + a;
+
+				for(size_t j = predstart[k]; j < predstart[k + 1]; j++)
+					nan_partition_mark(&p, preds[j]);
+			}
+
+			nan_partition_split(&p, worklist, &wlcount);
+		}
+	}
+
+	free(splitter);
+	free(worklist);
+	free(predstart);
+	free(preds);
+
+	/* BEGIN Renumbering; blocks are ordered by their least old state */
+	size_t * newid = nlex_malloc(NULL, sizeof(size_t) * p.nblocks);
+	NanDfaStateId * rep = nlex_malloc(NULL, sizeof(NanDfaStateId) * p.nblocks);
+	size_t   count = 0;
+
+	for(size_t b = 0; b < p.nblocks; b++)
+		newid[b] = SIZE_MAX;
+
+	newid[p.blk[0]] = count;
+	rep[count++] = 0;
+
+	for(size_t s = 1; s < n; s++) {
+		if(newid[p.blk[s]] == SIZE_MAX) {
+			newid[p.blk[s]] = count;
+			rep[count++] = s;
+		}
+	}
+
+	NanDfaStateId * trans = nlex_malloc(NULL,
+		sizeof(NanDfaStateId) * nsyms * count);
+	NanTreeNodeId * acc = nlex_malloc(NULL, sizeof(NanTreeNodeId) * count);
+	NanDfaSet     * sets = nlex_calloc_internal(count, sizeof(NanDfaSet));
+	bool          * fallback = nlex_malloc(NULL, sizeof(bool) * count);
+
+	for(size_t s = 0; s < count; s++) {
+		acc[s]      = dfa->acc[rep[s]];
+		fallback[s] = dfa->fallback[rep[s]];
+
+		if(fallback[s]) {
+			sets[s] = dfa->sets[rep[s]];
+			dfa->sets[rep[s]].items = NULL;
+		}
+
+		for(size_t a = 0; a < nsyms; a++)
+			trans[s * nsyms + a] =
+				newid[p.blk[nan_dfa_next(dfa, rep[s], a)]];
+	}
+
+	dfa->start = newid[p.blk[dfa->start]];
+	/* END Renumbering */
+
+	for(size_t s = 0; s < dfa->count; s++)
+		free(dfa->sets[s].items);
+
+	free(dfa->sets);
+	free(dfa->slots);
+	free(dfa->trans);
+	free(dfa->acc);
+	free(dfa->fallback);
+
+	dfa->sets     = sets;
+	dfa->slots    = NULL;
+	dfa->nslots   = 0;
+	dfa->trans    = trans;
+	dfa->acc      = acc;
+	dfa->fallback = fallback;
+	dfa->count    = count;
+	dfa->allocsiz = count;
+
+	free(newid);
+	free(rep);
+	free(p.elems);
+	free(p.loc);
+	free(p.blk);
+	free(p.first);
+	free(p.mid);
+	free(p.end);
+	free(p.touched);
+}
+
+static void nan_byte_print_c_case(unsigned int b, FILE * fp)
+{
+	if(isalnum(b) || (ispunct(b) && b != '\'' && b != '\\'))
+		fprintf(fp, "case '%c': ", b);
+	else
+		fprintf(fp, "case %u: ", b);
+}
+
+/* Most frequent target in the row; used as the `default` of the switch */
+static NanDfaStateId nan_dfa_row_mode(const NanDfaStateId * row, size_t nsyms)
+{
+	NanDfaStateId sorted[NAN_DFA_NSYMS];
+	NanDfaStateId mode = row[0];
+	size_t        modelen = 0;
+
+	memcpy(sorted, row, sizeof(NanDfaStateId) * nsyms);
+
+	/* Insertion sort; rows are small and mostly uniform. */
+	for(size_t i = 1; i < nsyms; i++) {
+		NanDfaStateId v = sorted[i];
+		size_t        j = i;
+
+		for(; j > 0 && sorted[j - 1] > v; j--)
+			sorted[j] = sorted[j - 1];
+
+		sorted[j] = v;
+	}
+
+	for(size_t i = 0; i < nsyms; ) {
+		size_t j = i;
+
+		while(j < nsyms && sorted[j] == sorted[i])
+			j++;
+
+		if(j - i > modelen) {
+			modelen = j - i;
+			mode    = sorted[i];
+		}
+
+		i = j;
+	}
+
+	return mode;
+}
+
+/* Whether state s can be entered by reading the terminating '\0' or EOF;
+ * only such states have to check for the end of input before reading.
+ */
+static bool * nan_dfa_mark_end_targets(const NanDfa * dfa)
+{
+	bool * marks = nlex_calloc_internal(dfa->count, sizeof(bool));
+
+	/* The end is not a byte then; see nan_dfa_print_read(). */
+	if(binary_input)
+		return marks;
+
+	for(NanDfaStateId s = 1; s < dfa->count; s++) {
+		marks[nan_dfa_next(dfa, s, dfa->classmap[0])]   = true;
+		marks[nan_dfa_next(dfa, s, dfa->classmap[255])] = true;
+	}
+
+	return marks;
+}
+
+/* Smallest unsigned type that can hold maxval */
+static const char * nan_c_uint_type(size_t maxval)
+{
+	if(maxval <= UINT8_MAX)
+		return "uint8_t";
+	else if(maxval <= UINT16_MAX)
+		return "uint16_t";
+	else
+		return "uint32_t";
+}
+
+static void nan_c_array_print(
+	const char * type, const char * name, const size_t * arr, size_t len)
+{
+	fprintf(fpout, "static const %s %s[%zu] = {", type, name, len);
+
+	for(size_t i = 0; i < len; i++)
+		fprintf(fpout, "%s%zu,", (i % 16)? " ": "\n", arr[i]);
+
+	fprintf(fpout, "\n};\n");
+}
+
+/* The byte class map, looked up once per byte; nothing is printed (and
+ * false returned) if each byte is its own class.
+ */
+static bool nan_dfa_classmap_print(const NanDfa * dfa)
+{
+	size_t classmap[NAN_DFA_NSYMS];
+
+	if(dfa->nsyms == NAN_DFA_NSYMS)
+		return false;
+
+	for(size_t b = 0; b < NAN_DFA_NSYMS; b++)
+		classmap[b] = dfa->classmap[b];
+
+	nan_c_array_print("uint8_t", "nlex_dfa_ec", classmap, NAN_DFA_NSYMS);
+	return true;
+}
+
+/* Transfer to state t; a label per state for the direct-coded scanner,
+ * an assignment to the dispatched variable otherwise.
+ */
+static void nan_dfa_print_goto(NanDfaStateId t, bool direct)
+{
+	if(!direct)
+		fprintf(fpout, "dfastate = %u; break;", t);
+	else if(t)
+		fprintf(fpout, "goto nlex_dfa_s%u;", t);
+	else
+		fprintf(fpout, "goto nlex_dfa_end;");
+}
+
+/* Reads the next byte into ch; with binary_input, EOF ends the scan. */
+static void nan_dfa_print_read(bool direct)
+{
+	if(!binary_input) {
+		fputs("\tch = nlex_next(nh);\n", fpout);
+	}
+	else {
+		fputs("\tch = nlex_next_byte(nh);\n\tif(ch == EOF) { ", fpout);
+		nan_dfa_print_goto(0, direct);
+		fputs(" }\n", fpout);
+	}
+
+	fputs(NAN_HASH_STEP, fpout);
+}
+
+/* The code of all the live states, either as the cases of
+ * switch(dfastate) or as labelled blocks (direct).
+ */
+static void nan_dfa_print_states(const NanDfa * dfa, bool direct)
+{
+	bool * endtgt = nan_dfa_mark_end_targets(dfa);
+	bool   classes = nan_dfa_classmap_print(dfa);
+
+	if(dfa->nfallbacks)
+		fprintf(fpout, "unsigned int dfa_fallback = 0;\n");
+
+	if(direct) {
+		fputs("{\n", fpout);
+		nan_dfa_print_goto(dfa->start, true);
+		fputs("\n", fpout);
+	}
+	else {
+		fprintf(fpout,
+			"unsigned int dfastate = %u;\n"
+			"while(dfastate) {\n"
+			"switch(dfastate) {\n",
+			dfa->start);
+	}
+
+	for(NanDfaStateId s = 1; s < dfa->count; s++) {
+		const NanDfaStateId * row = dfa->trans + (size_t) s * dfa->nsyms;
+		NanDfaStateId         deft = nan_dfa_row_mode(row, dfa->nsyms);
+
+		if(direct)
+			fprintf(fpout, "nlex_dfa_s%u:\n", s);
+		else
+			fprintf(fpout, "case %u:\n", s);
+
+		if(dfa->acc[s]) {
+			fprintf(fpout,
+				"\tnh->last_accepted_state = %u;\n"
+				"\tnh->curtoklen = nh->bufptr - nh->buf - nh->curtokpos + 1;\n",
+				dfa->acc[s]);
+			fputs(NAN_HASH_SAVE, fpout);
+		}
+
+		if(dfa->fallback[s]) {
+			fprintf(fpout, "\tdfa_fallback = %u;\n\t", s);
+			nan_dfa_print_goto(0, direct);
+			fputs("\n", fpout);
+			continue;
+		}
+
+		if(endtgt[s]) {
+			fputs("\tif(nlex_end_of_input(nh)) { ", fpout);
+			nan_dfa_print_goto(0, direct);
+			fputs(" }\n", fpout);
+		}
+
+		if(deft == 0) {
+			bool dead = true;
+
+			for(size_t sym = 0; sym < dfa->nsyms && dead; sym++)
+				dead = (row[sym] == 0);
+
+			/* No need to read another character just to fail. */
+			if(dead) {
+				fputs("\t", fpout);
+				nan_dfa_print_goto(0, direct);
+				fputs("\n", fpout);
+				continue;
+			}
+		}
+
+		nan_dfa_print_read(direct);
+		fprintf(fpout,
+			"\tswitch(%s(unsigned char) ch%s) {\n",
+			classes? "nlex_dfa_ec[": "", classes? "]": "");
+
+		bool printed[NAN_DFA_NSYMS] = { false };
+
+		for(size_t sym = 0; sym < dfa->nsyms; sym++) {
+			NanDfaStateId t = row[sym];
+
+			if(t == deft || printed[sym])
+				continue;
+
+			/* Print each target once, with all of its symbols */
+			fputs("\t", fpout);
+			for(size_t sym2 = sym; sym2 < dfa->nsyms; sym2++) {
+				if(row[sym2] == t) {
+					if(classes)
+						fprintf(fpout, "case %zu: ", sym2);
+					else
+						nan_byte_print_c_case(sym2, fpout);
+
+					printed[sym2] = true;
+				}
+			}
+
+			fputs("\n\t\t", fpout);
+			nan_dfa_print_goto(t, direct);
+			fputs("\n", fpout);
+		}
+
+		fputs("\tdefault: ", fpout);
+		nan_dfa_print_goto(deft, direct);
+		fputs("\n\t}\n", fpout);
+
+		if(!direct)
+			fputs("\tbreak;\n", fpout);
+	}
+
+	if(direct) {
+		fprintf(fpout,
+			"nlex_dfa_end: ;\n"
+			"}\n");
+	}
+	else {
+		fprintf(fpout,
+			"} /* switch(dfastate) */\n"
+			"} /* while(dfastate) */\n");
+	}
+
+	free(endtgt);
+}
+
+void nan_dfa_to_code_switch(const NanDfa * dfa)
+{
+	nan_dfa_print_states(dfa, false);
+}
+
+/* Direct-coded scanner: each state is a labelled block that jumps straight
+ * to the label of its successor, so there is no dispatch on a state
+ * variable at all.
+ */
+void nan_dfa_to_code_direct(const NanDfa * dfa)
+{
+	nan_dfa_print_states(dfa, true);
+}
+
+/* Row displacement ("comb") packing of the transition table. The most
+ * frequent target of a row becomes its default and only the others are
+ * stored in next[]; check[] tells which row owns a slot (0 for none,
+ * since the dead state has no row).
+ */
+static void nan_dfa_comb_pack(const NanDfa * dfa, NanDfaComb * comb)
+{
+	size_t   n = dfa->count;
+	size_t   nsyms = dfa->nsyms;
+	size_t * order = nlex_malloc(NULL, sizeof(size_t) * n);
+	size_t * density = nlex_calloc_internal(n, sizeof(size_t));
+
+	comb->base = nlex_calloc_internal(n, sizeof(size_t));
+	comb->deft = nlex_calloc_internal(n, sizeof(size_t));
+	comb->allocsiz = nsyms * 2;
+	comb->next  = nlex_calloc_internal(comb->allocsiz, sizeof(size_t));
+	comb->check = nlex_calloc_internal(comb->allocsiz, sizeof(size_t));
+	comb->len   = 0;
+
+	for(size_t s = 1; s < n; s++) {
+		const NanDfaStateId * row = dfa->trans + s * nsyms;
+
+		comb->deft[s] = nan_dfa_row_mode(row, nsyms);
+
+		for(size_t sym = 0; sym < nsyms; sym++)
+			if(row[sym] != comb->deft[s])
+				density[s]++;
+	}
+
+	/* Densest rows first; they are the hardest to fit. */
+	size_t norder = 0;
+	for(size_t d = nsyms; d > 0; d--)
+		for(size_t s = 1; s < n; s++)
+			if(density[s] == d)
+				order[norder++] = s;
+
+	size_t firstfree = 0;
+
+	for(size_t k = 0; k < norder; k++) {
+		size_t                s   = order[k];
+		const NanDfaStateId * row = dfa->trans + s * nsyms;
+		size_t                minsym = 0;
+
+		while(row[minsym] == comb->deft[s])
+			minsym++;
+
+		size_t base = (firstfree > minsym)? firstfree - minsym: 0;
+
+		for(;; base++) {
+			bool fits = true;
+
+			for(size_t sym = minsym; sym < nsyms && fits; sym++) {
+				if(row[sym] != comb->deft[s] && base + sym < comb->allocsiz)
+					fits = (comb->check[base + sym] == 0);
+			}
+
+			if(fits)
+				break;
+		}
+
+		if(base + nsyms > comb->allocsiz) {
+			size_t newsiz = (base + nsyms) * 2;
+
+			comb->next  = nlex_realloc(NULL, comb->next, sizeof(size_t) * newsiz);
+			comb->check = nlex_realloc(NULL, comb->check, sizeof(size_t) * newsiz);
+
+			memset(comb->next + comb->allocsiz, 0,
+				sizeof(size_t) * (newsiz - comb->allocsiz));
+			memset(comb->check + comb->allocsiz, 0,
+				sizeof(size_t) * (newsiz - comb->allocsiz));
+
+			comb->allocsiz = newsiz;
+		}
+
+		comb->base[s] = base;
+
+		for(size_t sym = minsym; sym < nsyms; sym++) {
+			if(row[sym] != comb->deft[s]) {
+				comb->next[base + sym]  = row[sym];
+				comb->check[base + sym] = s;
+
+				if(base + sym + 1 > comb->len)
+					comb->len = base + sym + 1;
+			}
+		}
+
+		while(firstfree < comb->allocsiz && comb->check[firstfree] != 0)
+			firstfree++;
+	}
+
+	/* Any base + symbol has to stay inside the arrays. */
+	size_t maxbase = 0;
+	for(size_t s = 1; s < n; s++)
+		if(comb->base[s] > maxbase)
+			maxbase = comb->base[s];
+
+	comb->len = maxbase + nsyms;
+
+	free(order);
+	free(density);
+}
+
+static void nan_dfa_comb_destruct(NanDfaComb * comb)
+{
+	free(comb->base);
+	free(comb->deft);
+	free(comb->next);
+	free(comb->check);
+}
+
+void nan_dfa_to_code_table(const NanDfa * dfa)
+{
+	NanDfaComb comb;
+	nan_dfa_comb_pack(dfa, &comb);
+
+	bool * endtgt = nan_dfa_mark_end_targets(dfa);
+	bool   classes = nan_dfa_classmap_print(dfa);
+
+	/* Action id, the fallback flag and the end-of-input check flag, packed
+	 * as (acc << 2 | fallback << 1 | check) to have one lookup per byte.
+	 */
+	size_t * accflags = nlex_malloc(NULL, sizeof(size_t) * dfa->count);
+	size_t   maxaccflags = 0;
+
+	for(size_t s = 0; s < dfa->count; s++) {
+		accflags[s] = ((size_t) dfa->acc[s] << 2) |
+			(dfa->fallback[s]? 2: 0) | (endtgt[s]? 1: 0);
+
+		if(accflags[s] > maxaccflags)
+			maxaccflags = accflags[s];
+	}
+
+	const char * sttype = nan_c_uint_type(dfa->count);
+
+	nan_c_array_print(nan_c_uint_type(comb.len), "nlex_dfa_base", comb.base, dfa->count);
+	nan_c_array_print(sttype, "nlex_dfa_deft", comb.deft, dfa->count);
+	nan_c_array_print(sttype, "nlex_dfa_next", comb.next, comb.len);
+	nan_c_array_print(sttype, "nlex_dfa_check", comb.check, comb.len);
+	nan_c_array_print(nan_c_uint_type(maxaccflags), "nlex_dfa_acc", accflags, dfa->count);
+
+	if(dfa->nfallbacks)
+		fprintf(fpout, "unsigned int dfa_fallback = 0;\n");
+
+	fprintf(fpout,
+		"unsigned int dfastate = %u;\n"
+		"while(dfastate) {\n"
+			"unsigned int accflags = nlex_dfa_acc[dfastate];\n"
+			"if(accflags) {\n"
+				"if(accflags >> 2) {\n"
+					"nh->last_accepted_state = accflags >> 2;\n"
+					"nh->curtoklen = nh->bufptr - nh->buf - nh->curtokpos + 1;\n"
+					"%s"
+				"}\n"
+				"%s"
+				"if((accflags & 1) && nlex_end_of_input(nh)) break;\n"
+			"}\n"
+			"%s"
+			"%s"
+			"size_t combi = nlex_dfa_base[dfastate] + %s(unsigned char) ch%s;\n"
+			"dfastate = (nlex_dfa_check[combi] == dfastate)? nlex_dfa_next[combi]: nlex_dfa_deft[dfastate];\n"
+		"} /* while(dfastate) */\n",
+		dfa->start,
+		NAN_HASH_SAVE,
+		dfa->nfallbacks? "if(accflags & 2) { dfa_fallback = dfastate; break; }\n": "",
+		binary_input? "ch = nlex_next_byte(nh);\nif(ch == EOF) break;\n": "ch = nlex_next(nh);\n",
+		NAN_HASH_STEP,
+		classes? "nlex_dfa_ec[": "", classes? "]": "");
+
+	free(accflags);
+	free(endtgt);
+	nan_dfa_comb_destruct(&comb);
+}
+
+void nan_dfa_to_code_parallel(const NanDfa * dfa, bool resync_nl)
+{
+	size_t   classmap[NAN_DFA_NSYMS];
+	size_t * trans = nlex_malloc(NULL, sizeof(size_t) * dfa->count * dfa->nsyms);
+	size_t * acc   = nlex_malloc(NULL, sizeof(size_t) * dfa->count);
+
+	assert(dfa->nfallbacks == 0);
+
+	for(size_t b = 0; b < NAN_DFA_NSYMS; b++)
+		classmap[b] = dfa->classmap[b];
+
+	for(size_t i = 0; i < dfa->count * dfa->nsyms; i++)
+		trans[i] = dfa->trans[i];
+
+	for(size_t s = 0; s < dfa->count; s++)
+		acc[s] = dfa->acc[s];
+
+	/* Scanned as a whole on the first call */
+	fprintf(fpout, "if(!nh->tokens) {\n");
+
+	nan_c_array_print("uint8_t", "nlex_par_ec", classmap, NAN_DFA_NSYMS);
+	nan_c_array_print("uint32_t", "nlex_par_trans", trans, dfa->count * dfa->nsyms);
+	nan_c_array_print("uint32_t", "nlex_par_acc", acc, dfa->count);
+
+	fprintf(fpout,
+			"static const NlexDfaDesc nlex_par_dfa = {\n"
+				"%zu, %zu, %u, nlex_par_ec, nlex_par_trans, nlex_par_acc, %d\n"
+			"};\n"
+			"nlex_par_scan(nh, &nlex_par_dfa);\n"
+		"}\n"
+		"if(nlex_par_next(nh)) {\n",
+		dfa->count, dfa->nsyms, dfa->start, resync_nl);
+
+	free(trans);
+	free(acc);
+}
+
+/* Opens the block that continues from the NFA set of the fallback state
+ * dfa_fallback; the NFA loop and the closing part are generated by the
+ * caller. The match the DFA has recorded (entering the fallback state
+ * included) stays unless the NFA code accepts again.
+ */
+void nan_dfa_fallback_to_code(const NanDfa * dfa, const NanNfa * nfa)
+{
+	fprintf(fpout,
+		"if(dfa_fallback) {\n"
+			"_Bool ch_set = 0;\n"
+			"unsigned int dfa_accepted = nh->last_accepted_state;\n"
+			"nlex_reset_states(nh);\n"
+			"nh->last_accepted_state = dfa_accepted;\n"
+			"switch(dfa_fallback) {\n");
+
+	for(NanDfaStateId s = 1; s < dfa->count; s++) {
+		if(!dfa->fallback[s])
+			continue;
+
+		fprintf(fpout, "case %u:", s);
+
+		for(size_t i = 0; i < dfa->sets[s].len; i++) {
+			NanTreeNode * node = nfa->states[dfa->sets[s].items[i]].node;
+
+			/* Its match is in dfa_accepted already */
+			if(nan_treenode_is_final(node))
+				continue;
+
+			fprintf(fpout, " nlex_nstack_push(nh, %u);", nan_tree_node_id(node));
+		}
+
+		fprintf(fpout, " break;\n");
+	}
+
+	fprintf(fpout,
+			"}\n");
+}
+
+/* Rules are told apart by their action ids, which follow the rule order. */
+void nan_dfa_fallback_report(const NanDfa * dfa, const NanNfa * nfa, FILE * fp)
+{
+	NanTreeNodeId maxacc = 0;
+
+	for(size_t i = 0; i < nfa->count; i++)
+		if(nfa->states[i].acc > maxacc)
+			maxacc = nfa->states[i].acc;
+
+	/* BEGIN Actions reachable from the fallback sets */
+	bool   * seen  = nlex_calloc_internal(nfa->count, sizeof(bool));
+	bool   * accfb = nlex_calloc_internal((size_t) maxacc + 1, sizeof(bool));
+	size_t * stack = nlex_malloc(NULL, sizeof(size_t) * (nfa->count + 1));
+	size_t   top   = 0;
+
+	for(NanDfaStateId s = 1; s < dfa->count; s++) {
+		for(size_t i = 0; dfa->fallback[s] && i < dfa->sets[s].len; i++) {
+			size_t idx = dfa->sets[s].items[i];
+
+			if(!seen[idx]) {
+				seen[idx] = true;
+				stack[top++] = idx;
+			}
+		}
+	}
+
+	while(top) {
+		const NanNfaState * st = &(nfa->states[stack[--top]]);
+
+		accfb[st->acc] = true;
+
+		for(size_t j = 0; j < st->nsucc; j++) {
+			if(!seen[st->succ[j]]) {
+				seen[st->succ[j]] = true;
+				stack[top++] = st->succ[j];
+			}
+		}
+	}
+	/* END Actions reachable from the fallback sets */
+
+	fprintf(fp, "nlexgen: DFA states: %zu; sets left to the NFA simulation: %zu\n",
+		dfa->count - 1 - dfa->nfallbacks, dfa->nfallbacks);
+
+	bool * isacc = nlex_calloc_internal((size_t) maxacc + 1, sizeof(bool));
+	for(size_t i = 0; i < nfa->count; i++)
+		isacc[nfa->states[i].acc] = true;
+
+	size_t rule = 0;
+	for(NanTreeNodeId a = 1; a <= maxacc; a++) {
+		if(!isacc[a])
+			continue;
+
+		fprintf(fp, "nlexgen: rule %zu (action %u): %s\n", ++rule, a,
+			accfb[a]? "DFA for the prefix, NFA simulation for the rest":
+			"DFA only");
+	}
+
+	free(isacc);
+	free(seen);
+	free(accfb);
+	free(stack);
+}
+
+/* The NFA as tables for the lazy DFA runtime (lazydfa.h); the DFA states
+ * are built by the generated scanner itself.
+ */
+void nan_nfa_to_code_lazy(const NanNfa * nfa)
+{
+	uint8_t  classmap[NAN_DFA_NSYMS];
+	size_t   nclasses = nan_nfa_byte_classes(nfa, classmap);
+	size_t   words = (nclasses + 31) / 32;
+	size_t   nsucc = 0;
+
+	/* Any byte of a class stands for all of it. */
+	unsigned int rep[NAN_DFA_NSYMS];
+	for(unsigned int b = NAN_DFA_NSYMS; b > 0; b--)
+		rep[classmap[b - 1]] = b - 1;
+
+	for(size_t i = 0; i < nfa->count; i++)
+		nsucc += nfa->states[i].nsucc;
+
+	size_t * ec        = nlex_malloc(NULL, sizeof(size_t) * NAN_DFA_NSYMS);
+	size_t * chsets    = nlex_calloc_internal(nfa->count * words, sizeof(size_t));
+	size_t * acc       = nlex_malloc(NULL, sizeof(size_t) * nfa->count);
+	size_t * succstart = nlex_malloc(NULL, sizeof(size_t) * (nfa->count + 1));
+	size_t * succ      = nlex_malloc(NULL, sizeof(size_t) * (nsucc? nsucc: 1));
+
+	for(size_t b = 0; b < NAN_DFA_NSYMS; b++)
+		ec[b] = classmap[b];
+
+	nsucc = 0;
+	for(size_t i = 0; i < nfa->count; i++) {
+		const NanNfaState * st = &(nfa->states[i]);
+
+		for(size_t c = 0; c < nclasses; c++)
+			if(nan_byte_set_has(&(st->chset), rep[c]))
+				chsets[i * words + c / 32] |= (size_t) 1 << (c % 32);
+
+		acc[i] = st->acc;
+		succstart[i] = nsucc;
+
+		for(size_t j = 0; j < st->nsucc; j++)
+			succ[nsucc++] = st->succ[j];
+	}
+	succstart[nfa->count] = nsucc;
+
+	nan_c_array_print("uint8_t", "nlex_nfa_ec", ec, NAN_DFA_NSYMS);
+	nan_c_array_print("uint32_t", "nlex_nfa_chsets", chsets, nfa->count * words);
+	nan_c_array_print("uint32_t", "nlex_nfa_acc", acc, nfa->count);
+	nan_c_array_print("uint32_t", "nlex_nfa_succstart", succstart, nfa->count + 1);
+	nan_c_array_print("uint32_t", "nlex_nfa_succ", succ, nsucc? nsucc: 1);
+
+	fprintf(fpout,
+		"static const NlexNfaDesc nlex_nfa = {\n"
+			".nstates = %zu, .start = %zu, .nclasses = %zu,\n"
+			".classmap = nlex_nfa_ec,\n"
+			".chsets = nlex_nfa_chsets, .chsetwords = %zu,\n"
+			".acc = nlex_nfa_acc,\n"
+			".succstart = nlex_nfa_succstart, .succ = nlex_nfa_succ,\n"
+		"};\n"
+		"NlexLazyDfa * ldfa = nlex_lazy_dfa_of(nh, &nlex_nfa, NLEX_LAZY_DFA_BUDGET);\n"
+		"uint32_t ldstate = nlex_lazy_dfa_start(nh, ldfa);\n"
+		"while(ldstate) {\n"
+			"const NlexLazyDfaState * lds = &(ldfa->states[ldstate]);\n"
+			"if(lds->acc) {\n"
+				"nh->last_accepted_state = lds->acc;\n"
+				"nh->curtoklen = nh->bufptr - nh->buf - nh->curtokpos + 1;\n"
+				"%s"
+			"}\n"
+			"if(lds->endchk && nlex_end_of_input(nh)) break;\n"
+			"ch = nlex_next(nh);\n"
+			"%s"
+			"ldstate = nlex_lazy_dfa_next(nh, ldfa, ldstate, ch);\n"
+		"} /* while(ldstate) */\n",
+		nfa->count, nfa->start, nclasses, words,
+		NAN_HASH_SAVE, NAN_HASH_STEP);
+
+	free(ec);
+	free(chsets);
+	free(acc);
+	free(succstart);
+	free(succ);
+}
+
+static void nan_c_u64_array_print(
+	const char * name, const uint64_t * arr, size_t len)
+{
+	fprintf(fpout, "static const uint64_t %s[%zu] = {", name, len);
+
+	for(size_t i = 0; i < len; i++)
+		fprintf(fpout, "%s0x%" PRIx64 "u,", (i % 4)? " ": "\n", arr[i]);
+
+	fprintf(fpout, "\n};\n");
+}
+
+/* Word w of the state set shifted towards the higher states by d (lower
+ * if d is negative); false if that is always 0.
+ */
+static bool nan_bitnfa_shift_print(long d, size_t w, size_t nwords)
+{
+	long   e = (d < 0)? -d: d;
+	long   q = e / 64;
+	long   r = e % 64;
+	long   src = (d < 0)? (long) w + q: (long) w - q;
+	long   nxt = (d < 0)? src + 1: src - 1;
+	bool   any = false;
+
+	if(src >= 0 && src < (long) nwords) {
+		if(r)
+			fprintf(fpout, "(bnfa%ld %s %ld)", src, (d < 0)? ">>": "<<", r);
+		else
+			fprintf(fpout, "bnfa%ld", src);
+		any = true;
+	}
+
+	if(r && nxt >= 0 && nxt < (long) nwords) {
+		fprintf(fpout, "%s(bnfa%ld %s %ld)", any? " | ": "", nxt,
+			(d < 0)? "<<": ">>", 64 - r);
+		any = true;
+	}
+
+	return any;
+}
+
+typedef struct NanBitNfaShift {
+	long   d;
+	size_t nedges;
+} NanBitNfaShift;
+
+static int nan_bitnfa_shift_cmp(const void * a, const void * b)
+{
+	const NanBitNfaShift * x = a;
+	const NanBitNfaShift * y = b;
+
+	if(x->nedges != y->nedges)
+		return (x->nedges < y->nedges) - (x->nedges > y->nedges);
+
+	return (x->d > y->d) - (x->d < y->d);
+}
+
+static size_t nan_bitnfa_shift_index(
+	const NanBitNfaShift * shifts, size_t nshifts, long d)
+{
+	size_t s;
+
+	for(s = 0; s < nshifts && shifts[s].d != d; s++)
+		;
+
+	return s;
+}
+
+/* A bit per NFA state (state i is bit i % 64 of word i / 64); the step is
+ * that of shift-and over Glushkov positions. Every state is entered on the
+ * same bytes whichever state pushes it, so the next set is the follow set
+ * of the live states masked by B[class of the byte]. The states are in
+ * tree preorder, which turns most edges into i -> i + 1; the follow set is
+ * taken a shift at a time, (D << d) & F[d], for the most used distances d.
+ * The few edges left (mostly from the start state) are looked up a byte of
+ * the set at a time, behind a test that skips the lookups when none of
+ * their sources is live. The accepting states share one mask; which rule
+ * won is worked out only when that mask hits.
+ */
+void nan_nfa_to_code_bitpar(const NanNfa * nfa)
+{
+	uint8_t  classmap[NAN_DFA_NSYMS];
+	size_t   nclasses = nan_nfa_byte_classes(nfa, classmap);
+	size_t   nwords   = (nfa->count + 63) / 64;
+	size_t   nchunks  = (nfa->count + 7) / 8;
+
+	if(nfa->count > NAN_BITNFA_MAX_STATES)
+		nlex_die("--bit-parallel needs at most %d NFA states; the rules have %zu.",
+			NAN_BITNFA_MAX_STATES, nfa->count);
+
+	unsigned int rep[NAN_DFA_NSYMS];
+	for(unsigned int b = NAN_DFA_NSYMS; b > 0; b--)
+		rep[classmap[b - 1]] = b - 1;
+
+	size_t   * ec     = nlex_malloc(NULL, sizeof(size_t) * NAN_DFA_NSYMS);
+	uint64_t * cls    = nlex_calloc_internal(nclasses * nwords, sizeof(uint64_t));
+	size_t   * acc    = nlex_malloc(NULL, sizeof(size_t) * nfa->count);
+	uint64_t   accany[2] = { 0, 0 };
+
+	for(size_t b = 0; b < NAN_DFA_NSYMS; b++)
+		ec[b] = classmap[b];
+
+	for(size_t i = 0; i < nfa->count; i++) {
+		for(size_t c = 0; c < nclasses; c++)
+			if(nan_byte_set_has(&(nfa->states[i].chset), rep[c]))
+				cls[c * nwords + i / 64] |= (uint64_t) 1 << (i % 64);
+
+		acc[i] = nfa->states[i].acc;
+		if(acc[i])
+			accany[i / 64] |= (uint64_t) 1 << (i % 64);
+	}
+
+	/* The distances of the edges, the most used first */
+	NanBitNfaShift shifts[2 * NAN_BITNFA_MAX_STATES];
+	size_t         nshifts = 0;
+
+	for(long d = 1 - (long) nfa->count; d < (long) nfa->count; d++)
+		shifts[nshifts++] = (NanBitNfaShift) { d, 0 };
+
+	for(size_t i = 0; i < nfa->count; i++)
+		for(size_t j = 0; j < nfa->states[i].nsucc; j++)
+			shifts[(long) nfa->states[i].succ[j] - (long) i + (long) nfa->count - 1].nedges++;
+
+	qsort(shifts, nshifts, sizeof(NanBitNfaShift), nan_bitnfa_shift_cmp);
+
+	while(nshifts > 0 && shifts[nshifts - 1].nedges == 0)
+		nshifts--;
+
+	/* A distance used once is no better as a shift than as a lookup. */
+	while(nshifts > NAN_BITNFA_MAX_SHIFTS ||
+	      (nshifts > 1 && shifts[nshifts - 1].nedges < 2))
+		nshifts--;
+
+	uint64_t * fmask  = nlex_calloc_internal((nshifts? nshifts: 1) * nwords, sizeof(uint64_t));
+	uint64_t * follow = nlex_calloc_internal(nchunks * 256 * nwords, sizeof(uint64_t));
+	size_t   * base   = nlex_malloc(NULL, sizeof(size_t) * nchunks);
+	uint64_t   excany[2] = { 0, 0 };
+	size_t     nfollow = 0;
+
+	for(size_t i = 0; i < nfa->count; i++) {
+		for(size_t j = 0; j < nfa->states[i].nsucc; j++) {
+			size_t u = nfa->states[i].succ[j];
+			size_t s = nan_bitnfa_shift_index(shifts, nshifts, (long) u - (long) i);
+
+			if(s < nshifts)
+				fmask[s * nwords + u / 64] |= (uint64_t) 1 << (u % 64);
+			else
+				excany[i / 64] |= (uint64_t) 1 << (i % 64);
+		}
+	}
+
+	/* The edges left, for the chunks that have any (base SIZE_MAX for the
+	 * rest)
+	 */
+	for(size_t k = 0; k < nchunks; k++) {
+		if(!(excany[k / 8] >> ((k % 8) * 8) & 255)) {
+			base[k] = SIZE_MAX;
+			continue;
+		}
+
+		base[k] = nfollow;
+
+		for(size_t v = 1; v < 256; v++) {
+			uint64_t * row = follow + (nfollow + v) * nwords;
+
+			for(size_t bit = 0; bit < 8; bit++) {
+				size_t i = k * 8 + bit;
+
+				if(!((v >> bit) & 1) || i >= nfa->count)
+					continue;
+
+				for(size_t j = 0; j < nfa->states[i].nsucc; j++) {
+					size_t u = nfa->states[i].succ[j];
+
+					if(nan_bitnfa_shift_index(shifts, nshifts, (long) u - (long) i) == nshifts)
+						row[u / 64] |= (uint64_t) 1 << (u % 64);
+				}
+			}
+		}
+
+		nfollow += 256;
+	}
+
+	nan_c_array_print("uint8_t", "nlex_bnfa_ec", ec, NAN_DFA_NSYMS);
+	nan_c_u64_array_print("nlex_bnfa_cls", cls, nclasses * nwords);
+	nan_c_array_print("uint32_t", "nlex_bnfa_acc", acc, nfa->count);
+	if(nfollow)
+		nan_c_u64_array_print("nlex_bnfa_follow", follow, nfollow * nwords);
+
+	for(size_t w = 0; w < nwords; w++)
+		fprintf(fpout, "uint64_t bnfa%zu = 0x%" PRIx64 "u;\n", w,
+			(nfa->start / 64 == w)? (uint64_t) 1 << (nfa->start % 64): 0);
+
+	fprintf(fpout,
+		"for(;;) {\n"
+			"ch = nlex_next(nh);\n"
+			"%s"
+			"const uint64_t * bcls = nlex_bnfa_cls + nlex_bnfa_ec[(unsigned char) ch] * %zu;\n",
+		NAN_HASH_STEP, nwords);
+
+	for(size_t w = 0; w < nwords; w++) {
+		fprintf(fpout, "uint64_t next%zu = 0", w);
+
+		for(size_t s = 0; s < nshifts; s++) {
+			if(!fmask[s * nwords + w])
+				continue;
+
+			fprintf(fpout, "\n| ((");
+			if(!nan_bitnfa_shift_print(shifts[s].d, w, nwords))
+				fprintf(fpout, "0");
+			fprintf(fpout, ") & 0x%" PRIx64 "u)", fmask[s * nwords + w]);
+		}
+
+		fprintf(fpout, ";\n");
+	}
+
+	if(nfollow) {
+		fprintf(fpout, "if(");
+		for(size_t w = 0, n = 0; w < nwords; w++)
+			if(excany[w])
+				fprintf(fpout, "%s(bnfa%zu & 0x%" PRIx64 "u)", n++? " | ": "", w, excany[w]);
+		fprintf(fpout, ") {\n");
+
+		for(size_t w = 0; w < nwords; w++) {
+			fprintf(fpout, "next%zu |= 0", w);
+
+			for(size_t k = 0; k < nchunks; k++) {
+				if(base[k] == SIZE_MAX)
+					continue;
+
+				fprintf(fpout, "\n| nlex_bnfa_follow[(%zu + ((bnfa%zu >> %zu) & 255)) * %zu + %zu]",
+					base[k], k / 8, (k % 8) * 8, nwords, w);
+			}
+
+			fprintf(fpout, ";\n");
+		}
+
+		fprintf(fpout, "}\n");
+	}
+
+	for(size_t w = 0; w < nwords; w++)
+		fprintf(fpout, "bnfa%zu = next%zu & bcls[%zu];\n", w, w, w);
+
+	fprintf(fpout, "if(!(bnfa0%s)) break;\n", (nwords > 1)? " | bnfa1": "");
+
+	/* The rule with the lowest action id among the accepting states */
+	if(accany[0] | accany[1]) {
+		fprintf(fpout, "uint64_t bacc0 = bnfa0 & 0x%" PRIx64 "u;\n", accany[0]);
+		if(nwords > 1)
+			fprintf(fpout, "uint64_t bacc1 = bnfa1 & 0x%" PRIx64 "u;\n", accany[1]);
+
+		fprintf(fpout,
+			"if(bacc0%s) {\n"
+				"uint32_t bact = UINT32_MAX;\n",
+			(nwords > 1)? " | bacc1": "");
+
+		for(size_t w = 0; w < nwords; w++)
+			fprintf(fpout,
+				"for(uint64_t m = bacc%zu; m; m &= m - 1) {\n"
+					"uint32_t a = nlex_bnfa_acc[%zu + __builtin_ctzll(m)];\n"
+					"if(a < bact) bact = a;\n"
+				"}\n",
+				w, w * 64);
+
+		fprintf(fpout,
+				"nh->last_accepted_state = bact;\n"
+				"nh->curtoklen = nh->bufptr - nh->buf - nh->curtokpos + 1;\n"
+				"%s"
+			"}\n",
+			NAN_HASH_SAVE);
+	}
+
+	fprintf(fpout,
+			"if((ch == 0 || ch == EOF) && nlex_end_of_input(nh)) break;\n"
+		"} /* for bnfa */\n");
+
+	free(ec);
+	free(cls);
+	free(acc);
+	free(fmask);
+	free(follow);
+	free(base);
+}
@@ -0,0 +1,176 @@
+/* dfa.h
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+#ifndef _N96E_LEX_DFA_H
+#define _N96E_LEX_DFA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tree.h"
+
+/* Number of input bytes; the runtime compares `char ch`, so EOF shares
+ * the last slot with the byte 0xFF just like it does in the NFA code
+ * (unless binary_input).
+ * The transitions are over byte classes (see nan_nfa_byte_classes()), of
+ * which there are at most as many.
+ */
+#define NAN_DFA_NSYMS 256
+
+/* 0 is the dead state (no live NFA state left). */
+typedef unsigned int NanDfaStateId;
+
+typedef struct NanByteSet {
+	uint64_t bits[4];
+} NanByteSet;
+
+/* One state per non-action tree node. This is the automaton simulated at
+ * runtime by the tstack/nstack code; nan_nfa_construct() collects exactly
+ * what nan_inode_to_code() emits for the node's `case`.
+ */
+typedef struct NanNfaState {
+	NanTreeNode * node;
+	NanByteSet    chset;  /* Bytes for which a push of this state happens */
+	NanTreeNodeId acc;    /* Highest-priority action registered; 0 if none */
+	size_t      * succ;   /* States that can be pushed from this one */
+	size_t        nsucc;
+	size_t        succ_allocsiz;
+} NanNfaState;
+
+typedef struct NanNfa {
+	NanNfaState * states;
+	size_t        count;
+	size_t        allocsiz;
+	size_t        start;
+
+	/* Node id to state index + 1 (0 for ids that are not states) */
+	size_t      * index_of_id;
+	size_t        index_of_id_len;
+} NanNfa;
+
+typedef struct NanDfaSet {
+	size_t * items; /* Sorted NFA state indices */
+	size_t   len;
+	size_t   hash;
+} NanDfaSet;
+
+typedef struct NanDfa {
+	NanDfaStateId * trans; /* count * nsyms entries */
+	NanTreeNodeId * acc;   /* Action id per state; 0 if not accepting */
+	NanDfaSet     * sets;  /* Only those of the fallback states after
+	                        * minimization */
+	size_t          count;
+	size_t          allocsiz;
+	NanDfaStateId   start;
+
+	NanDfaStateId * slots; /* Open-addressing table over sets */
+	size_t          nslots;
+
+	/* States beyond the budget given to nan_dfa_construct(); these are not
+	 * expanded, and the scanner continues from their NFA sets with the
+	 * tstack/nstack simulation instead.
+	 */
+	bool          * fallback;
+	size_t          nfallbacks;
+
+	/* Byte to class; identity (with nsyms = NAN_DFA_NSYMS) if disabled */
+	uint8_t         classmap[NAN_DFA_NSYMS];
+	size_t          nsyms;
+} NanDfa;
+
+static inline void nan_byte_set_add(NanByteSet * bs, unsigned int b)
+{
+	bs->bits[b >> 6] |= (uint64_t) 1 << (b & 63);
+}
+
+static inline bool nan_byte_set_has(const NanByteSet * bs, unsigned int b)
+{
+	return (bs->bits[b >> 6] >> (b & 63)) & 1;
+}
+
+/* Runtime value of `ch` after reading the byte b (char is assumed signed
+ * in the generated code, making EOF and 0xFF indistinguishable). With
+ * binary_input, ch is the byte itself, and EOF is not read as a byte at
+ * all: the scanner stops on it.
+ */
+static inline int nan_byte_to_ch(unsigned int b)
+{
+	if(binary_input)
+		return (int) b;
+
+	return (b == 255)? EOF: (int) (signed char) b;
+}
+
+static inline NanDfaStateId
+	nan_dfa_next(const NanDfa * dfa, NanDfaStateId s, unsigned int sym)
+{
+	return dfa->trans[(size_t) s * dfa->nsyms + sym];
+}
+
+/* Whether the runtime check generated for c accepts ch */
+bool nan_character_matches(NlexCharacter c, int ch);
+void nan_treenode_get_byteset(const NanTreeNode * node, NanByteSet * bs);
+
+/* Call after nan_tree_mark_accepts(), whose actions the states take. */
+void nan_nfa_construct(NanNfa * nfa, NanTreeNode * root);
+void nan_nfa_destruct(NanNfa * nfa);
+
+/* Whether any action is registered after reading exactly s from the start
+ * state (the bytes of s as the runtime reads them).
+ */
+bool nan_nfa_accepts(const NanNfa * nfa, const char * s);
+
+/* Partition the bytes into classes no state can tell apart; returns the
+ * number of classes. Classes are numbered by their least byte.
+ */
+size_t nan_nfa_byte_classes(const NanNfa * nfa, uint8_t * classmap);
+
+/* max_states limits the number of expanded states (0 for no limit) */
+void nan_dfa_construct(NanDfa * dfa, const NanNfa * nfa,
+	bool equiv_classes, size_t max_states);
+void nan_dfa_destruct(NanDfa * dfa);
+
+/* Merge the equivalent states; invalidates dfa->sets */
+void nan_dfa_minimize(NanDfa * dfa);
+
+/* Compressed transition table; see nan_dfa_comb_pack() */
+typedef struct NanDfaComb {
+	size_t * base;  /* Per state */
+	size_t * deft;  /* Per state */
+	size_t * next;
+	size_t * check;
+	size_t   len;
+	size_t   allocsiz;
+} NanDfaComb;
+
+/* Conversion of the DFA; emits the code that replaces the nstack loop */
+void nan_dfa_to_code_switch(const NanDfa * dfa);
+void nan_dfa_to_code_direct(const NanDfa * dfa);
+void nan_dfa_to_code_table(const NanDfa * dfa);
+
+/* Tables for the parallel scan (parlex.h) and the opening of the block
+ * that dispatches the next token; no fallback states allowed.
+ */
+void nan_dfa_to_code_parallel(const NanDfa * dfa, bool resync_nl);
+
+/* Code that hands the fallback states over to the NFA loop (which has to
+ * follow), and the per-rule report of what got determinized.
+ */
+void nan_dfa_fallback_to_code(const NanDfa * dfa, const NanNfa * nfa);
+void nan_dfa_fallback_report(const NanDfa * dfa, const NanNfa * nfa, FILE * fp);
+
+/* NFA tables for the lazy DFA runtime (lazydfa.h) */
+void nan_nfa_to_code_lazy(const NanNfa * nfa);
+
+/* Simulation of the NFA with the set of live states in one or two 64-bit
+ * words (hence the limit on the number of states).
+ */
+#define NAN_BITNFA_MAX_STATES 128
+/* Edge distances taken by a shift; the rest are table lookups */
+#define NAN_BITNFA_MAX_SHIFTS 8
+void nan_nfa_to_code_bitpar(const NanNfa * nfa);
+
+#endif
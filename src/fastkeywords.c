@@ -8,11 +8,11 @@
 _Bool fastkeywords_enabled;
 
 _Bool fastkeywords_use_strcmp;
+_Bool fastkeywords_use_phash;
 _Bool fastkeywords_use_length_based_trie = true;
 _Bool fastkeywords_fuse_single_child = true;
 
-_Bool fastkeywords_fuse_as_int;
-_Bool big_endian;
+_Bool fastkeywords_fuse_as_int = true;
 NanTreeNode *idactnode;
 
 void trie_node_set_sibling(TrieNode *this, TrieNode *sibling_in)
@@ -33,7 +33,7 @@ void trie_node_add(TrieNode *this, const char * key, int keyoffset, const char *
 		TrieNode *chld;
 		size_t klen = strlen(key);
 
-		assert(klen > 0); /* fastkeywords.ngg:46 */
+		assert(klen > 0); /* fastkeywords.ngg:43 */
 
 		chld = this->first_child;
 		while(chld) {
@@ -62,7 +62,7 @@ void trie_node_add(TrieNode *this, const char * key, int keyoffset, const char *
 	}
 
 	if('\0' == key[keyoffset]) {
-		assert(!this->action); /* fastkeywords.ngg:67 */
+		assert(!this->action); /* fastkeywords.ngg:64 */
 
 		this->action = action;
 		return;
@@ -96,7 +96,7 @@ void trie_node_add(TrieNode *this, const char * key, int keyoffset, const char *
 void trie_node_append(TrieNode *this, TrieNode *chld)
 {
 	if(!this->first_child) {
-		assert(!this->last_child); /* fastkeywords.ngg:90 */
+		assert(!this->last_child); /* fastkeywords.ngg:87 */
 		TrieNode *_ngg_tmp_2 = chld;
 		if(this->first_child) {
 			trie_node_destruct((TrieNode *) this->first_child);
@@ -104,23 +104,11 @@ void trie_node_append(TrieNode *this, TrieNode *chld)
 		}
 
 		this->first_child = _ngg_tmp_2;
-		TrieNode *_ngg_tmp_3 = chld;
-		if(this->last_child) {
-			trie_node_destruct((TrieNode *) this->last_child);
-			free(this->last_child);
-		}
-
-		this->last_child = _ngg_tmp_3;
+		this->last_child = chld;
 	} else {
 		assert(this->last_child);
 		trie_node_set_sibling(this->last_child, chld);
-		TrieNode *_ngg_tmp_4 = chld;
-		if(this->last_child) {
-			trie_node_destruct((TrieNode *) this->last_child);
-			free(this->last_child);
-		}
-
-		this->last_child = _ngg_tmp_4;
+		this->last_child = chld;
 	}
 }
 
@@ -136,11 +124,6 @@ void trie_node_destruct(TrieNode *this)
 		free(this->first_child);
 	}
 
-	if(this->last_child) {
-		trie_node_destruct((TrieNode *) this->last_child);
-		free(this->last_child);
-	}
-
 	if(this->sibling) {
 		trie_node_destruct((TrieNode *) this->sibling);
 		free(this->sibling);
@@ -152,7 +135,7 @@ void trie_node_construct(TrieNode *this)
 	this->cond_printed = false;
 	this->keylen = 0u;
 	this->ch = '\0';
-	this->action = "";
+	this->action = NULL;
 	this->sibling = NULL;
 	this->last_child = NULL;
 	this->first_child = NULL;
@@ -209,7 +192,7 @@ void fastkeywords_trie_to_code(TrieNode *root, int level, FILE * fp)
 void fastkeywords_trie_to_code_not_lengthwise(TrieNode *root, int level, FILE * fp)
 {
 	TrieNode *chld;
-	assert(root->keylen == 0); /* fastkeywords.ngg:139 */
+	assert(root->keylen == 0); /* fastkeywords.ngg:136 */
 
 	fprintf(fp, "if(nh->curtoklen > %d) {\n", level);
 
@@ -240,7 +223,7 @@ void fastkeywords_trie_to_code_lengthwise(TrieNode *root, int level, FILE * fp)
 
 	chld = root->first_child;
 	while(chld) {
-		assert(chld->keylen > 0); /* fastkeywords.ngg:169 */
+		assert(chld->keylen > 0); /* fastkeywords.ngg:166 */
 
 		fprintf(fp, "case %zu:\n", chld->keylen);
 		fastkeywords_trie_to_code_lengthwise_nonroot(chld, level, fp);
@@ -298,44 +281,18 @@ void fastkeywords_trie_to_code_lengthwise_nonroot_fuse_single_child(TrieNode *ro
 				nschld = count_single_children(chld);
 			}
 
-			_Bool use_hex = true;
+			_Bool use_memcmp = nschld > 0;
 
-			switch(nschld) {
-			case 1:
-			{
-				fprintf(fp, "if(*((short *) (nh->buf + nh->curtokpos + %d)) == ", level);
-				break;
-			}
-			case 3:
-			{
-				fprintf(fp, "if(*((int *) (nh->buf + nh->curtokpos + %d)) == ", level);
-				break;
-			}
-			case 7:
-			{
-				fprintf(fp, "if(*((long *) (nh->buf + nh->curtokpos + %d)) == ", level);
-				break;
-			}
-			default:
-			{
+			if(use_memcmp) {
+				fprintf(fp, "if(0 == memcmp(nh->buf + nh->curtokpos + %d, \"%c", level, chld->ch);
+			} else {
 				fprintf(fp, "if(nh->buf[nh->curtokpos + %d] == \'%c\'", level, chld->ch);
-				use_hex = false;
-				break;
-			}
 			}
 
-			if(use_hex) {
-				if(big_endian) {
-					fprintf(fp, "0x%2x", chld->ch);
-				} else {
-					fprintf(fp, "0x");
-				}
-			}
-
-			fuse_single_children(chld, level + 1, use_hex, fp);
+			fuse_single_children(chld, level + 1, use_memcmp, fp);
 
-			if(use_hex && (!big_endian)) {
-				fprintf(fp, "%2x", chld->ch);
+			if(use_memcmp) {
+				fprintf(fp, "\", %d)", nschld + 1);
 			}
 
 			fputs(") {\n", fp);
@@ -372,27 +329,21 @@ int count_single_children(TrieNode *root)
 	return 0;
 }
 
-void fuse_single_children(TrieNode *root, int level, _Bool use_hex, FILE * fp)
+void fuse_single_children(TrieNode *root, int level, _Bool use_memcmp, FILE * fp)
 {
 	if(root->first_child) {
 		TrieNode *fc;
 		fc = (TrieNode *) root->first_child;
 		if(!fc->sibling) {
-			if(use_hex && (!big_endian)) {
-				fuse_single_children(fc, level + 1, use_hex, fp);
-			}
-
-			if(use_hex) {
-				fprintf(fp, "%2x", fc->ch);
+			if(use_memcmp) {
+				fprintf(fp, "%c", fc->ch);
 			} else {
 				fprintf(fp, " && nh->buf[nh->curtokpos + %d] == \'%c\'", level, fc->ch);
 			}
 
 			fc->cond_printed = true;
 
-			if((!use_hex) || big_endian) {
-				fuse_single_children(fc, level + 1, use_hex, fp);
-			}
+			fuse_single_children(fc, level + 1, use_memcmp, fp);
 		}
 	}
 }
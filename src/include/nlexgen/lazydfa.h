@@ -0,0 +1,3 @@
+// See read.h in this directory.
+
+#include "../../lazydfa.h"
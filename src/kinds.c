@@ -0,0 +1,128 @@
+/* kinds.c
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "error.h"
+#include "kinds.h"
+
+/* The action without the blanks around it */
+static char * nan_kind_name(const char * actstr)
+{
+	const char * end;
+
+	while(isspace((unsigned char) *actstr))
+		actstr++;
+
+	for(end = actstr + strlen(actstr); end > actstr && isspace((unsigned char) end[-1]); end--);
+
+	return strndup(actstr, end - actstr);
+}
+
+static bool nan_kind_name_is_valid(const char * name)
+{
+	if(!isalpha((unsigned char) *name) && *name != '_')
+		return false;
+
+	for(; *name; name++)
+		if(!isalnum((unsigned char) *name) && *name != '_')
+			return false;
+
+	return true;
+}
+
+/* The number of the kind, adding it if new */
+static size_t nan_kind_number(NanKinds * kinds, char * name)
+{
+	for(size_t i = 0; i < kinds->count; i++) {
+		if(0 == strcmp(kinds->names[i], name)) {
+			free(name);
+			return i + 1;
+		}
+	}
+
+	kinds->names = realloc(kinds->names, sizeof(char *) * (kinds->count + 1));
+	if(!kinds->names)
+		nlex_die("realloc() failed.");
+
+	kinds->names[kinds->count++] = name;
+	return kinds->count;
+}
+
+/* The rules hang off the root in their order until the tree is simplified. */
+static void nan_kinds_from_actions(NanKinds * kinds, NanTreeNode * node)
+{
+	if(node->visited)
+		return;
+	else
+		node->visited = true;
+
+	if(node->ch == NLEX_CASE_ACT) {
+		char * name = nan_kind_name(nan_treenode_get_actstr(node));
+		char * code;
+
+		if(!*name) {
+			free(name);
+			code = strdup("");
+		}
+		else {
+			if(!nan_kind_name_is_valid(name))
+				nlex_die("--scan-batch: `%s' is not a token kind name (a C identifier).", name);
+
+			code = malloc(strlen(name) + sizeof("kind = ;"));
+			if(code)
+				sprintf(code, "kind = %s;", name);
+
+			nan_kind_number(kinds, name);
+		}
+
+		if(!code)
+			nlex_die("malloc() failed.");
+
+		free((char *) nan_treenode_get_actstr(node));
+		nan_treenode_set_actstr(node, code);
+		return;
+	}
+
+	for(NanTreeNode * chld = node->first_child; chld; chld = chld->sibling)
+		nan_kinds_from_actions(kinds, chld);
+}
+
+void nlg_kinds_init(NanKinds * kinds)
+{
+	kinds->names = NULL;
+	kinds->count = 0;
+}
+
+void nlg_kinds_free(NanKinds * kinds)
+{
+	for(size_t i = 0; i < kinds->count; i++)
+		free(kinds->names[i]);
+
+	free(kinds->names);
+	nlg_kinds_init(kinds);
+}
+
+size_t nlg_kinds_from_actions(NanTreeNode * root, NanKinds * kinds)
+{
+	nan_tree_unvisit(root);
+	nan_kinds_from_actions(kinds, root);
+	nan_tree_unvisit(root);
+
+	return kinds->count;
+}
+
+void nlg_kinds_to_code(const NanKinds * kinds, const char * tag, FILE * fp)
+{
+	if(!kinds->count)
+		return;
+
+	fprintf(fp, "enum %s_kind {\n", tag);
+	for(size_t i = 0; i < kinds->count; i++)
+		fprintf(fp, "\t%s = %zu,\n", kinds->names[i], i + 1);
+	fprintf(fp, "};\n\n");
+}
@@ -0,0 +1,40 @@
+/* kinds.h
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+/* Token kinds for --scan-batch. The action of each rule is the name of the
+ * kind of its tokens (a C identifier) instead of code, or nothing for the
+ * rules whose tokens are skipped (blanks, comments). The kinds are numbered
+ * from 1 in the order the names first appear among the rules.
+ */
+
+#ifndef _N96E_LEX_KINDS_H
+#define _N96E_LEX_KINDS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "tree.h"
+
+/* The names of the kinds; the kind numbered n is names[n - 1] */
+typedef struct NanKinds {
+	char   ** names;
+	size_t    count;
+} NanKinds;
+
+void nlg_kinds_init(NanKinds * kinds);
+void nlg_kinds_free(NanKinds * kinds);
+
+/* Replaces the action of each rule with code that sets the local `kind`
+ * (left 0 for the skipped tokens), adding the kinds named to kinds. Call
+ * right after nlg_build_tree(), so that nlg_split_keywords() takes the new
+ * actions along. Returns the number of kinds.
+ */
+size_t nlg_kinds_from_actions(NanTreeNode * root, NanKinds * kinds);
+
+/* enum TAG_kind { NAME = 1, ... }; nothing if there are no kinds */
+void nlg_kinds_to_code(const NanKinds * kinds, const char * tag, FILE * fp);
+
+#endif
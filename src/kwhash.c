@@ -0,0 +1,393 @@
+/* kwhash.c
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+
+#include "error.h"
+#include "kwhash.h"
+#include "read.h"
+
+/* Tries per bucket before giving up on a seed, and seeds to try */
+#define NAN_KWHASH_MAX_DISP  (1u << 18)
+#define NAN_KWHASH_MAX_SEEDS 64
+
+/* XXX The following three have to match the code emitted by
+ * nan_kwhash_to_code() exactly.
+ */
+static inline size_t nan_kwhash_index(NanKwhashPos p, size_t len)
+{
+	if(p.fromend)
+		return (p.off < len)? len - 1 - p.off: 0;
+	else
+		return (p.off < len)? p.off: len - 1;
+}
+
+static uint32_t nan_kwhash_hash(const NanKwhash * kh,
+	const char * key, size_t len, uint32_t seed)
+{
+	uint32_t h = seed;
+
+	h = (h ^ (uint32_t) len) * 16777619u;
+
+	for(size_t i = 0; i < kh->npos; i++)
+		h = (h ^ (unsigned char) key[nan_kwhash_index(kh->pos[i], len)]) * 16777619u;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+
+	return h;
+}
+
+static inline size_t nan_kwhash_slot(uint32_t h, uint32_t disp, size_t nkeys)
+{
+	uint32_t g = (h ^ disp) * 0x9e3779b1u;
+
+	g ^= g >> 16;
+
+	return ((uint64_t) g * nkeys) >> 32;
+}
+
+/* BEGIN Selection of the bytes */
+typedef struct NanKwhashTuple {
+	uint32_t v[NAN_KWHASH_MAX_POS + 1];
+} NanKwhashTuple;
+
+static int nan_kwhash_tuple_cmp(const void * a, const void * b)
+{
+	return memcmp(a, b, sizeof(NanKwhashTuple));
+}
+
+static size_t nan_kwhash_count_distinct(const NanKwhashPos * pos, size_t npos,
+	const char * const * keys, size_t nkeys, NanKwhashTuple * tuples)
+{
+	size_t distinct = 0;
+
+	memset(tuples, 0, sizeof(NanKwhashTuple) * nkeys);
+
+	for(size_t k = 0; k < nkeys; k++) {
+		size_t len = strlen(keys[k]);
+
+		tuples[k].v[0] = len;
+		for(size_t i = 0; i < npos; i++)
+			tuples[k].v[i + 1] = (unsigned char) keys[k][nan_kwhash_index(pos[i], len)];
+	}
+
+	qsort(tuples, nkeys, sizeof(NanKwhashTuple), nan_kwhash_tuple_cmp);
+
+	for(size_t k = 0; k < nkeys; k++)
+		if(k == 0 || nan_kwhash_tuple_cmp(&tuples[k - 1], &tuples[k]) != 0)
+			distinct++;
+
+	return distinct;
+}
+
+/* Greedy; each step adds the byte that tells the most keys apart. */
+static bool nan_kwhash_select_positions(
+	NanKwhash * kh, const char * const * keys, size_t nkeys)
+{
+	size_t           maxlen = 0;
+	NanKwhashTuple * tuples = nlex_malloc(NULL, sizeof(NanKwhashTuple) * nkeys);
+
+	for(size_t k = 0; k < nkeys; k++)
+		if(strlen(keys[k]) > maxlen)
+			maxlen = strlen(keys[k]);
+
+	kh->npos = 0;
+
+	while(nan_kwhash_count_distinct(kh->pos, kh->npos, keys, nkeys, tuples) < nkeys) {
+		size_t       best = 0;
+		NanKwhashPos bestpos = { 0, false };
+
+		if(kh->npos == NAN_KWHASH_MAX_POS) {
+			free(tuples);
+			return false;
+		}
+
+		for(size_t off = 0; off < maxlen; off++) {
+			for(int fromend = 0; fromend < 2; fromend++) {
+				kh->pos[kh->npos] = (NanKwhashPos) { off, fromend };
+
+				size_t n = nan_kwhash_count_distinct(
+					kh->pos, kh->npos + 1, keys, nkeys, tuples);
+
+				if(n > best) {
+					best    = n;
+					bestpos = kh->pos[kh->npos];
+				}
+			}
+		}
+
+		kh->pos[kh->npos++] = bestpos;
+	}
+
+	free(tuples);
+	return true;
+}
+/* END Selection of the bytes */
+
+typedef struct NanKwhashBucket {
+	size_t size;
+	size_t bucket;
+} NanKwhashBucket;
+
+static int nan_kwhash_bucket_cmp(const void * a, const void * b)
+{
+	const NanKwhashBucket * x = a;
+	const NanKwhashBucket * y = b;
+
+	/* Larger buckets first; they are the hardest to place. */
+	if(x->size != y->size)
+		return (x->size < y->size)? 1: -1;
+
+	return (x->bucket > y->bucket) - (x->bucket < y->bucket);
+}
+
+/* Hash and displace with the given seed; fills kh->disp and kh->slot_of */
+static bool nan_kwhash_try_seed(NanKwhash * kh,
+	const char * const * keys, uint32_t seed, uint32_t * hashes)
+{
+	size_t            nkeys    = kh->nkeys;
+	size_t            nbuckets = kh->nbuckets;
+	size_t          * bstart   = nlex_calloc_internal(nbuckets + 1, sizeof(size_t));
+	size_t          * members  = nlex_malloc(NULL, sizeof(size_t) * nkeys);
+	NanKwhashBucket * order    = nlex_malloc(NULL, sizeof(NanKwhashBucket) * nbuckets);
+	size_t          * sizes    = nlex_calloc_internal(nbuckets, sizeof(size_t));
+	bool            * taken    = nlex_calloc_internal(nkeys, sizeof(bool));
+	size_t            slots[64];
+	bool              ok = true;
+
+	for(size_t k = 0; k < nkeys; k++) {
+		hashes[k] = nan_kwhash_hash(kh, keys[k], strlen(keys[k]), seed);
+		sizes[((uint64_t) hashes[k] * nbuckets) >> 32]++;
+	}
+
+	for(size_t b = 0; b < nbuckets; b++) {
+		bstart[b + 1] = bstart[b] + sizes[b];
+		order[b].size   = sizes[b];
+		order[b].bucket = b;
+		sizes[b] = 0;
+	}
+
+	for(size_t k = 0; k < nkeys; k++) {
+		size_t b = ((uint64_t) hashes[k] * nbuckets) >> 32;
+		members[bstart[b] + sizes[b]++] = k;
+	}
+
+	qsort(order, nbuckets, sizeof(NanKwhashBucket), nan_kwhash_bucket_cmp);
+
+	for(size_t i = 0; ok && i < nbuckets; i++) {
+		size_t   b = order[i].bucket;
+		size_t * m = members + bstart[b];
+		uint32_t d;
+
+		/* A bucket this large means a bad seed. */
+		if(sizes[b] > sizeof(slots) / sizeof(slots[0])) {
+			ok = false;
+			break;
+		}
+
+		/* Keys with the same hash in a bucket would never separate. */
+		for(size_t j = 0; ok && j < sizes[b]; j++)
+			for(size_t j2 = 0; ok && j2 < j; j2++)
+				ok = (hashes[m[j]] != hashes[m[j2]]);
+
+		if(!ok)
+			break;
+
+		for(d = 0; d < NAN_KWHASH_MAX_DISP; d++) {
+			bool fits = true;
+
+			for(size_t j = 0; fits && j < sizes[b]; j++) {
+				slots[j] = nan_kwhash_slot(hashes[m[j]], d, nkeys);
+
+				fits = !taken[slots[j]];
+				for(size_t j2 = 0; fits && j2 < j; j2++)
+					fits = (slots[j2] != slots[j]);
+			}
+
+			if(fits)
+				break;
+		}
+
+		if(d == NAN_KWHASH_MAX_DISP) {
+			ok = false;
+			break;
+		}
+
+		kh->disp[b] = d;
+
+		for(size_t j = 0; j < sizes[b]; j++) {
+			taken[slots[j]] = true;
+			kh->slot_of[m[j]] = slots[j];
+		}
+	}
+
+	kh->seed = seed;
+
+	free(bstart);
+	free(members);
+	free(order);
+	free(sizes);
+	free(taken);
+
+	return ok;
+}
+
+bool nan_kwhash_build(NanKwhash * kh, const char * const * keys, size_t nkeys)
+{
+	memset(kh, 0, sizeof(NanKwhash));
+
+	if(nkeys == 0 || !nan_kwhash_select_positions(kh, keys, nkeys))
+		return false;
+
+	kh->nkeys    = nkeys;
+	kh->nbuckets = (nkeys + NAN_KWHASH_BUCKET_LOAD - 1) / NAN_KWHASH_BUCKET_LOAD;
+	kh->disp     = nlex_calloc_internal(kh->nbuckets, sizeof(uint32_t));
+	kh->slot_of  = nlex_malloc(NULL, sizeof(size_t) * nkeys);
+
+	uint32_t * hashes = nlex_malloc(NULL, sizeof(uint32_t) * nkeys);
+	uint32_t   seed   = 2166136261u;
+
+	for(size_t attempt = 0; attempt < NAN_KWHASH_MAX_SEEDS; attempt++) {
+		if(nan_kwhash_try_seed(kh, keys, seed, hashes)) {
+			free(hashes);
+			return true;
+		}
+
+		seed += 0x9e3779b9u;
+	}
+
+	free(hashes);
+	nan_kwhash_destruct(kh);
+
+	return false;
+}
+
+void nan_kwhash_destruct(NanKwhash * kh)
+{
+	free(kh->disp);
+	free(kh->slot_of);
+
+	kh->disp    = NULL;
+	kh->slot_of = NULL;
+}
+
+static void nan_kwhash_print_string(const char * s, FILE * fp)
+{
+	fputc('"', fp);
+
+	for(; *s; s++) {
+		if(isalnum((unsigned char) *s) || *s == '_')
+			fputc(*s, fp);
+		else
+			fprintf(fp, "\\%03o", (unsigned char) *s);
+	}
+
+	fputc('"', fp);
+}
+
+void nan_kwhash_to_code(const NanKwhash * kh, const char * const * keys,
+	const char * const * actions, const char * label, FILE * fp)
+{
+	size_t * key_at = nlex_malloc(NULL, sizeof(size_t) * kh->nkeys);
+	size_t   maxlen = 0;
+	uint32_t maxdisp = 0;
+
+	for(size_t k = 0; k < kh->nkeys; k++) {
+		key_at[kh->slot_of[k]] = k;
+
+		if(strlen(keys[k]) > maxlen)
+			maxlen = strlen(keys[k]);
+	}
+
+	for(size_t b = 0; b < kh->nbuckets; b++)
+		if(kh->disp[b] > maxdisp)
+			maxdisp = kh->disp[b];
+
+	/* A block of its own, so that the tables can be emitted more than once */
+	fprintf(fp, "{\nstatic const char * const nlex_kw_str[%zu] = {", kh->nkeys);
+	for(size_t s = 0; s < kh->nkeys; s++) {
+		fputs((s % 8)? " ": "\n", fp);
+		nan_kwhash_print_string(keys[key_at[s]], fp);
+		fputc(',', fp);
+	}
+	fputs("\n};\n", fp);
+
+	fprintf(fp, "static const %s nlex_kw_len[%zu] = {",
+		(maxlen <= UINT8_MAX)? "uint8_t": "size_t", kh->nkeys);
+	for(size_t s = 0; s < kh->nkeys; s++)
+		fprintf(fp, "%s%zu,", (s % 16)? " ": "\n", strlen(keys[key_at[s]]));
+	fputs("\n};\n", fp);
+
+	fprintf(fp, "static const %s nlex_kw_disp[%zu] = {",
+		(maxdisp <= UINT16_MAX)? "uint16_t": "uint32_t", kh->nbuckets);
+	for(size_t b = 0; b < kh->nbuckets; b++)
+		fprintf(fp, "%s%u,", (b % 16)? " ": "\n", kh->disp[b]);
+	fputs("\n};\n", fp);
+
+	fprintf(fp,
+			"const char * kw = nh->buf + nh->curtokpos;\n"
+			"size_t kwlen = nh->curtoklen;\n"
+			"uint32_t kwh = %uu;\n"
+			"kwh = (kwh ^ (uint32_t) kwlen) * 16777619u;\n",
+		kh->seed);
+
+	for(size_t i = 0; i < kh->npos; i++) {
+		if(kh->pos[i].fromend)
+			fprintf(fp,
+				"kwh = (kwh ^ (unsigned char) kw[(kwlen > %zu)? kwlen - %zu: 0]) * 16777619u;\n",
+				kh->pos[i].off, kh->pos[i].off + 1);
+		else
+			fprintf(fp,
+				"kwh = (kwh ^ (unsigned char) kw[(kwlen > %zu)? %zu: kwlen - 1]) * 16777619u;\n",
+				kh->pos[i].off, kh->pos[i].off);
+	}
+
+	fprintf(fp,
+			"kwh ^= kwh >> 16;\n"
+			"kwh *= 0x85ebca6bu;\n"
+			"kwh ^= kwh >> 13;\n"
+			"uint32_t kwg = (kwh ^ nlex_kw_disp[((uint64_t) kwh * %zu) >> 32]) * 0x9e3779b1u;\n"
+			"kwg ^= kwg >> 16;\n"
+			"size_t kwslot = ((uint64_t) kwg * %zu) >> 32;\n"
+			"if(nlex_kw_len[kwslot] == kwlen && 0 == memcmp(kw, nlex_kw_str[kwslot], kwlen)) {\n"
+				"switch(kwslot) {\n",
+		kh->nbuckets, kh->nkeys);
+
+	for(size_t s = 0; s < kh->nkeys; s++)
+		fprintf(fp, "case %zu:\n%s\ngoto %s;\n", s, actions[key_at[s]], label);
+
+	fputs(
+				"}\n"
+			"}\n"
+		"}\n", fp);
+
+	free(key_at);
+}
+
+void nan_kwlist_to_code(const char * const * keys,
+	const char * const * actions, size_t nkeys, const char * label, FILE * fp)
+{
+	NanKwhash kh;
+
+	if(nan_kwhash_build(&kh, keys, nkeys)) {
+		nan_kwhash_to_code(&kh, keys, actions, label, fp);
+		nan_kwhash_destruct(&kh);
+		return;
+	}
+
+	for(size_t k = 0; k < nkeys; k++) {
+		fprintf(fp,
+			"if(nh->curtoklen == %zu && 0 == memcmp(nh->buf + nh->curtokpos, ",
+			strlen(keys[k]));
+		nan_kwhash_print_string(keys[k], fp);
+		fprintf(fp, ", %zu)) {\n%s\ngoto %s;\n}\n",
+			strlen(keys[k]), actions[k], label);
+	}
+}
@@ -0,0 +1,65 @@
+/* kwhash.h
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+/* Minimal perfect hashing of the fast keywords (hash and displace). The
+ * hash is over the length and a few bytes of the key, chosen so that no
+ * two keywords agree on all of them; the generated code looks up a single
+ * table slot and confirms the match with one memcmp().
+ */
+
+#ifndef _N96E_LEX_KWHASH_H
+#define _N96E_LEX_KWHASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define NAN_KWHASH_MAX_POS 8
+
+/* Average number of keys per bucket */
+#define NAN_KWHASH_BUCKET_LOAD 4
+
+/* A byte of the key; off counts from the end if fromend. Clamped to the
+ * key, so that every key has all the selected bytes.
+ */
+typedef struct NanKwhashPos {
+	size_t off;
+	bool   fromend;
+} NanKwhashPos;
+
+typedef struct NanKwhash {
+	NanKwhashPos pos[NAN_KWHASH_MAX_POS];
+	size_t       npos;
+	uint32_t     seed;
+
+	uint32_t   * disp;     /* Per bucket */
+	size_t       nbuckets;
+
+	size_t     * slot_of;  /* Key index to slot; slots are 0..nkeys-1 */
+	size_t       nkeys;
+} NanKwhash;
+
+/* Returns false (leaving nothing to destruct) if the keys cannot be told
+ * apart by NAN_KWHASH_MAX_POS bytes or if no hash was found.
+ */
+bool nan_kwhash_build(NanKwhash * kh, const char * const * keys, size_t nkeys);
+void nan_kwhash_destruct(NanKwhash * kh);
+
+/* Emits the tables and the lookup of the current token; a match runs
+ * actions[i] for keys[i] and jumps to label. The code falls through if
+ * the token is not a keyword.
+ */
+void nan_kwhash_to_code(const NanKwhash * kh, const char * const * keys,
+	const char * const * actions, const char * label, FILE * fp);
+
+/* The same lookup with the tables built here; falls back to comparing
+ * the keys one by one if there is no perfect hash for them.
+ */
+void nan_kwlist_to_code(const char * const * keys,
+	const char * const * actions, size_t nkeys, const char * label, FILE * fp);
+
+#endif
@@ -0,0 +1,256 @@
+/* kwsplit.c
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "dfa.h"
+#include "kwhash.h"
+#include "kwsplit.h"
+
+/* The string matched by the rule if it is a plain one; NULL otherwise */
+static char * nan_rule_literal(const NanTreeNode * first)
+{
+	const NanTreeNode * tptr;
+	size_t              len = 0;
+
+	for(tptr = first; tptr->ch != NLEX_CASE_ACT; tptr = tptr->first_child) {
+		if(tptr->ch <= 0 || tptr->klnptr || tptr->klnptr_from)
+			return NULL;
+
+		if(!tptr->first_child || tptr->first_child->sibling)
+			return NULL;
+
+		len++;
+	}
+
+	char * text = nlex_malloc(NULL, len + 1);
+
+	len = 0;
+	for(tptr = first; tptr->ch != NLEX_CASE_ACT; tptr = tptr->first_child)
+		text[len++] = tptr->ch;
+	text[len] = '\0';
+
+	return text;
+}
+
+/* The action node of the rule and whether it has a repetition; call after
+ * nan_tree_unvisit().
+ */
+static void nan_rule_scan(NanTreeNode * node, NanTreeNode ** act, bool * kleene)
+{
+	if(node->visited)
+		return;
+	else
+		node->visited = true;
+
+	if(node->ch == NLEX_CASE_ACT)
+		*act = node;
+
+	if(node->klnptr)
+		*kleene = true;
+
+	for(NanTreeNode * tptr = node->first_child; tptr; tptr = tptr->sibling)
+		nan_rule_scan(tptr, act, kleene);
+}
+
+/* NFA of a single rule */
+static void nan_rule_nfa_construct(NanNfa * nfa, NanTreeNode * rule)
+{
+	NanTreeNode   tmproot;
+	NanTreeNode * sibbak = rule->sibling;
+
+	nlg_tree_init_root(&tmproot);
+	tmproot.first_child = rule;
+	rule->sibling       = NULL;
+
+	nan_tree_unvisit(&tmproot);
+	nan_tree_mark_accepts(&tmproot);
+
+	nan_nfa_construct(nfa, &tmproot);
+
+	rule->sibling = sibbak;
+	nan_tree_unvisit(rule);
+}
+
+void nlg_split_keywords_init(NanSplitKeywords * skw)
+{
+	skw->items = NULL;
+	skw->count = 0;
+}
+
+void nlg_split_keywords_free(NanSplitKeywords * skw)
+{
+	for(size_t i = 0; i < skw->count; i++)
+		free((char *) skw->items[i].text);
+
+	free(skw->items);
+	nlg_split_keywords_init(skw);
+}
+
+size_t nlg_split_keywords(NanTreeNode * root, NanSplitKeywords * skw)
+{
+	size_t nrules = 0;
+
+	for(NanTreeNode * tptr = root->first_child; tptr; tptr = tptr->sibling)
+		nrules++;
+
+	NanTreeNode ** rules   = nlex_calloc_internal(nrules + 1, sizeof(NanTreeNode *));
+	NanTreeNode ** acts    = nlex_calloc_internal(nrules + 1, sizeof(NanTreeNode *));
+	char        ** texts   = nlex_calloc_internal(nrules + 1, sizeof(char *));
+	bool         * kleene  = nlex_calloc_internal(nrules + 1, sizeof(bool));
+	bool         * taken   = nlex_calloc_internal(nrules + 1, sizeof(bool));
+	NanNfa       * nfas    = nlex_calloc_internal(nrules + 1, sizeof(NanNfa));
+
+	size_t i = 0;
+	for(NanTreeNode * tptr = root->first_child; tptr; tptr = tptr->sibling, i++) {
+		rules[i] = tptr;
+		texts[i] = nan_rule_literal(tptr);
+
+		nan_tree_unvisit(tptr);
+		nan_rule_scan(tptr, &(acts[i]), &(kleene[i]));
+		nan_tree_unvisit(tptr);
+
+		if(!texts[i])
+			nan_rule_nfa_construct(&(nfas[i]), tptr);
+	}
+
+	size_t ntaken = 0;
+
+	for(i = 0; i < nrules; i++) {
+		if(!texts[i])
+			continue;
+
+		/* A string given twice is left to the automaton */
+		bool dup = false;
+		for(size_t k = 0; k < nrules && !dup; k++)
+			dup = (k != i && texts[k] && 0 == strcmp(texts[k], texts[i]));
+
+		if(dup)
+			continue;
+
+		size_t host = nrules;
+		for(size_t k = 0; k < nrules && host == nrules; k++)
+			if(!texts[k] && nan_nfa_accepts(&(nfas[k]), texts[i]))
+				host = k;
+
+		if(host == nrules || host < i || !kleene[host])
+			continue;
+
+		skw->items = nlex_realloc(NULL, skw->items,
+			sizeof(NanSplitKeyword) * (skw->count + 1));
+
+		NanSplitKeyword * kw = &(skw->items[skw->count++]);
+		kw->host   = acts[host];
+		kw->text   = texts[i];
+		kw->action = nan_treenode_get_actstr(acts[i]);
+
+		taken[i] = true;
+		ntaken++;
+	}
+
+	/* Relink the rules that stay */
+	NanTreeNode * last = NULL;
+
+	root->first_child = NULL;
+
+	for(i = 0; i < nrules; i++) {
+		if(taken[i])
+			continue;
+
+		if(last)
+			last->sibling = rules[i];
+		else
+			root->first_child = rules[i];
+
+		last = rules[i];
+	}
+
+	if(last)
+		last->sibling = NULL;
+
+	for(i = 0; i < nrules; i++) {
+		if(!texts[i])
+			nan_nfa_destruct(&(nfas[i]));
+		else if(!taken[i])
+			free(texts[i]);
+	}
+
+	free(rules);
+	free(acts);
+	free(texts);
+	free(kleene);
+	free(taken);
+	free(nfas);
+
+	return ntaken;
+}
+
+void nlg_split_keywords_to_code(
+	const NanSplitKeywords * skw, const NanTreeNode * act, FILE * fp)
+{
+	size_t nkeys = 0;
+
+	for(size_t i = 0; i < skw->count; i++)
+		if(skw->items[i].host == act)
+			nkeys++;
+
+	if(!nkeys)
+		return;
+
+	const char ** keys    = nlex_calloc_internal(nkeys, sizeof(char *));
+	const char ** actions = nlex_calloc_internal(nkeys, sizeof(char *));
+
+	nkeys = 0;
+	for(size_t i = 0; i < skw->count; i++) {
+		if(skw->items[i].host == act) {
+			keys[nkeys]    = skw->items[i].text;
+			actions[nkeys] = skw->items[i].action;
+			nkeys++;
+		}
+	}
+
+	nan_kwlist_to_code(keys, actions, nkeys, NLG_KWSPLIT_LABEL, fp);
+
+	free(keys);
+	free(actions);
+}
+
+NanTreeNode * nlg_fastkw_id_action(NanTreeNode * root)
+{
+	NanTreeNode * idact = NULL;
+
+	for(NanTreeNode * tptr = root->first_child; tptr; tptr = tptr->sibling) {
+		if(tptr->ch == NLEX_CASE_FASTKWACT)
+			continue;
+
+		NanTreeNode * act    = NULL;
+		bool          kleene = false;
+
+		nan_tree_unvisit(tptr);
+		nan_rule_scan(tptr, &act, &kleene);
+		nan_tree_unvisit(tptr);
+
+		if(!kleene)
+			continue;
+
+		NanNfa nfa;
+		bool   all = true;
+
+		nan_rule_nfa_construct(&nfa, tptr);
+
+		for(NanTreeNode * kptr = root->first_child; kptr && all; kptr = kptr->sibling)
+			if(kptr->ch == NLEX_CASE_FASTKWACT)
+				all = nan_nfa_accepts(&nfa, kptr->fastkw_pattern);
+
+		nan_nfa_destruct(&nfa);
+
+		if(all)
+			idact = act;
+	}
+
+	return idact;
+}
@@ -0,0 +1,61 @@
+/* kwsplit.h
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+/* Keyword rules (plain strings) that another rule also matches are taken
+ * out of the automaton, and the token is looked up among them when that
+ * rule, the host, wins. For a keyword, the host is the first of the other
+ * rules that matches it (the one that wins its text once the keywords are
+ * gone); the host has to have a repetition (identifier-like rules do) and
+ * has to come after the keyword. Other keywords stay in the automaton.
+ */
+
+#ifndef _N96E_LEX_KWSPLIT_H
+#define _N96E_LEX_KWSPLIT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "tree.h"
+
+/* Where the lookup jumps after running the action of a keyword */
+#define NLG_KWSPLIT_LABEL "after_kwsplit"
+
+typedef struct NanSplitKeyword {
+	const NanTreeNode * host;   /* Action node of the host rule */
+	const char        * text;
+	const char        * action;
+} NanSplitKeyword;
+
+/* The keywords taken out, for the code of their hosts */
+typedef struct NanSplitKeywords {
+	NanSplitKeyword * items;
+	size_t            count;
+} NanSplitKeywords;
+
+void nlg_split_keywords_init(NanSplitKeywords * skw);
+
+/* Frees the texts of the keywords, too (the actions stay with the tree) */
+void nlg_split_keywords_free(NanSplitKeywords * skw);
+
+/* Adds the keyword rules taken out of the tree to skw. Call after
+ * nan_tree_number() and before nan_tree_simplify(); returns the number of
+ * keyword rules taken out.
+ */
+size_t nlg_split_keywords(NanTreeNode * root, NanSplitKeywords * skw);
+
+/* The lookup for the host rule whose action node is act (nothing if the
+ * rule hosts no keywords).
+ */
+void nlg_split_keywords_to_code(
+	const NanSplitKeywords * skw, const NanTreeNode * act, FILE * fp);
+
+/* The action node of the ID rule for --fastkeywords: the last rule with a
+ * repetition that accepts every keyword; NULL if there is none. Call after
+ * nan_tree_number().
+ */
+NanTreeNode * nlg_fastkw_id_action(NanTreeNode * root);
+
+#endif
@@ -0,0 +1,270 @@
+/* lazydfa.c
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+#include "lazydfa.h"
+
+/* Approximate cost of a cached state, the set excluded (the hash table is
+ * kept at most half full).
+ */
+static inline size_t nlex_lazy_dfa_state_cost(const NlexLazyDfa * ld)
+{
+	return sizeof(NlexLazyDfaState) +
+		sizeof(uint32_t) * (ld->nfa->nclasses + 2);
+}
+
+static size_t nlex_lazy_dfa_hash(const uint32_t * items, size_t len)
+{
+	size_t h = 14695981039346656037UL;
+
+	for(size_t i = 0; i < len; i++) {
+		h ^= items[i];
+		h *= 1099511628211UL;
+	}
+
+	return h;
+}
+
+static int nlex_uint32_cmp(const void * a, const void * b)
+{
+	uint32_t x = *((const uint32_t *) a);
+	uint32_t y = *((const uint32_t *) b);
+
+	return (x > y) - (x < y);
+}
+
+static void nlex_lazy_dfa_slot_insert(NlexLazyDfa * ld, uint32_t s)
+{
+	size_t slot = ld->states[s].hash & (ld->nslots - 1);
+
+	while(ld->slots[slot])
+		slot = (slot + 1) & (ld->nslots - 1);
+
+	ld->slots[slot] = s + 1;
+}
+
+static void nlex_lazy_dfa_rehash(NlexHandle * nh, NlexLazyDfa * ld)
+{
+	ld->nslots = ld->nslots? ld->nslots * 2: 64;
+	ld->slots  = nlex_realloc(nh, ld->slots, sizeof(uint32_t) * ld->nslots);
+	memset(ld->slots, 0, sizeof(uint32_t) * ld->nslots);
+
+	/* The dead state is never looked up, so it is not stored. */
+	for(uint32_t s = 1; s < ld->count; s++)
+		nlex_lazy_dfa_slot_insert(ld, s);
+}
+
+static uint32_t nlex_lazy_dfa_add(NlexHandle * nh, NlexLazyDfa * ld,
+	const uint32_t * items, size_t len, size_t hash)
+{
+	const NlexNfaDesc * nfa = ld->nfa;
+
+	if(ld->count >= ld->allocsiz) {
+		ld->allocsiz = ld->allocsiz? ld->allocsiz * 2: 64;
+		ld->states   = nlex_realloc(nh, ld->states,
+			sizeof(NlexLazyDfaState) * ld->allocsiz);
+		ld->trans    = nlex_realloc(nh, ld->trans,
+			sizeof(uint32_t) * nfa->nclasses * ld->allocsiz);
+	}
+
+	if(ld->poollen + len > ld->poolallocsiz) {
+		ld->poolallocsiz = (ld->poollen + len) * 2;
+		ld->pool = nlex_realloc(nh, ld->pool, sizeof(uint32_t) * ld->poolallocsiz);
+	}
+
+	uint32_t           s  = ld->count++;
+	NlexLazyDfaState * st = &(ld->states[s]);
+
+	st->setpos = ld->poollen;
+	st->setlen = len;
+	st->hash   = hash;
+	st->acc    = 0;
+	st->endchk = 0;
+
+	if(len)
+		memcpy(ld->pool + ld->poollen, items, sizeof(uint32_t) * len);
+	ld->poollen += len;
+
+	/* The member with the least action id wins, as in the NFA code. */
+	for(size_t i = 0; i < len; i++) {
+		uint32_t acc = nfa->acc[items[i]];
+
+		if(acc != 0 && (st->acc == 0 || acc < st->acc))
+			st->acc = acc;
+	}
+
+	memset(ld->trans + (size_t) s * nfa->nclasses, 0xFF,
+		sizeof(uint32_t) * nfa->nclasses);
+
+	if(s == 0)
+		return s;
+
+	if(ld->count * 2 > ld->nslots)
+		nlex_lazy_dfa_rehash(nh, ld);
+	else
+		nlex_lazy_dfa_slot_insert(ld, s);
+
+	return s;
+}
+
+/* Drop everything but the dead and the start states */
+static void nlex_lazy_dfa_flush(NlexLazyDfa * ld)
+{
+	ld->count   = 2;
+	ld->poollen = ld->states[1].setpos + ld->states[1].setlen;
+
+	memset(ld->slots, 0, sizeof(uint32_t) * ld->nslots);
+	nlex_lazy_dfa_slot_insert(ld, 1);
+
+	memset(ld->trans + ld->nfa->nclasses, 0xFF,
+		sizeof(uint32_t) * ld->nfa->nclasses);
+
+	ld->flushes++;
+}
+
+static uint32_t nlex_lazy_dfa_lookup_or_add(
+	NlexHandle * nh, NlexLazyDfa * ld, const uint32_t * items, size_t len)
+{
+	if(len == 0)
+		return 0;
+
+	size_t hash = nlex_lazy_dfa_hash(items, len);
+	size_t slot = hash & (ld->nslots - 1);
+
+	while(ld->slots[slot]) {
+		uint32_t                 s   = ld->slots[slot] - 1;
+		const NlexLazyDfaState * st  = &(ld->states[s]);
+
+		if( st->hash == hash && st->setlen == len &&
+		    0 == memcmp(ld->pool + st->setpos, items, sizeof(uint32_t) * len) )
+		{
+			return s;
+		}
+
+		slot = (slot + 1) & (ld->nslots - 1);
+	}
+
+	size_t usage = ld->count * nlex_lazy_dfa_state_cost(ld) +
+		(ld->poollen + len) * sizeof(uint32_t);
+
+	if(ld->count > 2 && usage + nlex_lazy_dfa_state_cost(ld) > ld->budget)
+		nlex_lazy_dfa_flush(ld);
+
+	return nlex_lazy_dfa_add(nh, ld, items, len, hash);
+}
+
+uint32_t nlex_lazy_dfa_start(NlexHandle * nh, NlexLazyDfa * ld)
+{
+	if(ld->count == 0) {
+		const NlexNfaDesc * nfa = ld->nfa;
+		uint32_t            start = nfa->start;
+
+		ld->stamp    = nlex_realloc(nh, ld->stamp, sizeof(uint32_t) * nfa->nstates);
+		ld->subset   = nlex_realloc(nh, ld->subset, sizeof(uint32_t) * nfa->nstates);
+		ld->stampval = 0;
+		memset(ld->stamp, 0, sizeof(uint32_t) * nfa->nstates);
+
+		nlex_lazy_dfa_rehash(nh, ld);
+		nlex_lazy_dfa_add(nh, ld, NULL, 0, 0);
+		nlex_lazy_dfa_add(nh, ld, &start, 1, nlex_lazy_dfa_hash(&start, 1));
+
+		/* Accepting here would mean a token of zero length (e.g. `.*`) */
+		ld->states[1].acc = 0;
+	}
+
+	return 1;
+}
+
+/* Slow path of nlex_lazy_dfa_next(); the subset construction step */
+uint32_t nlex_lazy_dfa_compute(
+	NlexHandle * nh, NlexLazyDfa * ld, uint32_t s, unsigned int cls)
+{
+	const NlexNfaDesc * nfa   = ld->nfa;
+	const uint32_t    * items = ld->pool + ld->states[s].setpos;
+	size_t              len   = ld->states[s].setlen;
+	size_t              sublen = 0;
+
+	if(++(ld->stampval) == 0) {
+		memset(ld->stamp, 0, sizeof(uint32_t) * nfa->nstates);
+		ld->stampval = 1;
+	}
+
+	for(size_t i = 0; i < len; i++) {
+		for(uint32_t j = nfa->succstart[items[i]]; j < nfa->succstart[items[i] + 1]; j++) {
+			uint32_t         u     = nfa->succ[j];
+			const uint32_t * chset = nfa->chsets + (size_t) u * nfa->chsetwords;
+
+			if(ld->stamp[u] == ld->stampval)
+				continue;
+
+			ld->stamp[u] = ld->stampval;
+
+			if((chset[cls >> 5] >> (cls & 31)) & 1)
+				ld->subset[sublen++] = u;
+		}
+	}
+
+	qsort(ld->subset, sublen, sizeof(uint32_t), nlex_uint32_cmp);
+
+	size_t   flushes = ld->flushes;
+	uint32_t t = nlex_lazy_dfa_lookup_or_add(nh, ld, ld->subset, sublen);
+
+	if(t && (cls == nfa->classmap[0] || cls == nfa->classmap[255]))
+		ld->states[t].endchk = 1;
+
+	/* s itself is gone if the cache was flushed for t. */
+	if(ld->flushes == flushes || s == 1)
+		ld->trans[(size_t) s * nfa->nclasses + cls] = t;
+
+	return t;
+}
+
+void nlex_lazy_dfa_free(NlexLazyDfa * ld)
+{
+	free(ld->states);
+	free(ld->trans);
+	free(ld->pool);
+	free(ld->slots);
+	free(ld->stamp);
+	free(ld->subset);
+
+	ld->states = NULL;
+	ld->trans  = NULL;
+	ld->pool   = NULL;
+	ld->slots  = NULL;
+	ld->stamp  = NULL;
+	ld->subset = NULL;
+
+	ld->count = ld->allocsiz = 0;
+	ld->poollen = ld->poolallocsiz = 0;
+	ld->nslots = 0;
+}
+
+static void nlex_lazy_dfa_delete(void * p)
+{
+	nlex_lazy_dfa_free(p);
+	free(p);
+}
+
+NlexLazyDfa * nlex_lazy_dfa_of(NlexHandle * nh, const NlexNfaDesc * nfa, size_t budget)
+{
+	NlexLazyDfa * ld = nh->lazy_dfa;
+
+	if(ld && ld->nfa == nfa)
+		return ld;
+
+	/* First call, or the handle has been used with another scanner */
+	if(nh->lazy_dfa_free)
+		nh->lazy_dfa_free(nh->lazy_dfa);
+
+	ld = nlex_calloc_internal(1, sizeof(NlexLazyDfa));
+	ld->nfa    = nfa;
+	ld->budget = budget;
+
+	nh->lazy_dfa      = ld;
+	nh->lazy_dfa_free = nlex_lazy_dfa_delete;
+
+	return ld;
+}
@@ -0,0 +1,99 @@
+/* lazydfa.h
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+/* Runtime for the scanners generated with --lazy-dfa. The NFA is kept as
+ * tables and the DFA states are built while scanning, as the input needs
+ * them, and cached. The cache is flushed once it outgrows its budget, so
+ * the rule sets that blow up under full determinization still work.
+ */
+
+#ifndef _N96E_LEX_LAZYDFA_H
+#define _N96E_LEX_LAZYDFA_H
+
+#include <stdint.h>
+
+#include "read.h"
+
+/* Cache size in bytes; define before including to override */
+#ifndef NLEX_LAZY_DFA_BUDGET
+#define NLEX_LAZY_DFA_BUDGET (1 << 20)
+#endif
+
+/* Transition that is not computed yet */
+#define NLEX_LAZY_DFA_UNKNOWN UINT32_MAX
+
+/* NFA description emitted by nlexgen; see nan_nfa_to_code_lazy() */
+typedef struct NlexNfaDesc {
+	size_t           nstates;
+	size_t           start;
+	size_t           nclasses;
+	const uint8_t  * classmap;   /* Byte to class */
+	const uint32_t * chsets;     /* Classes a state accepts, chsetwords each */
+	size_t           chsetwords;
+	const uint32_t * acc;        /* Action id per state; 0 if none */
+	const uint32_t * succstart;  /* nstates + 1 offsets into succ */
+	const uint32_t * succ;
+} NlexNfaDesc;
+
+typedef struct NlexLazyDfaState {
+	size_t   setpos;  /* NFA states, sorted, at pool[setpos] */
+	size_t   setlen;
+	size_t   hash;
+	uint32_t acc;     /* Action id; 0 if not accepting */
+	_Bool    endchk;  /* Entered by '\0' or EOF; check before reading */
+} NlexLazyDfaState;
+
+/* Can be initialized with just nfa and budget. State 0 is the dead state
+ * and 1 is the start state, even after a flush.
+ */
+typedef struct NlexLazyDfa {
+	const NlexNfaDesc * nfa;
+	size_t              budget;
+
+	NlexLazyDfaState  * states;
+	uint32_t          * trans;    /* count * nfa->nclasses */
+	size_t              count;
+	size_t              allocsiz;
+
+	uint32_t          * pool;     /* NFA state sets */
+	size_t              poollen;
+	size_t              poolallocsiz;
+
+	uint32_t          * slots;    /* Open addressing; state + 1, 0 if free */
+	size_t              nslots;
+
+	uint32_t          * stamp;    /* Per NFA state, for deduplication */
+	uint32_t          * subset;
+	uint32_t            stampval;
+
+	size_t              flushes;  /* Number of times the cache was dropped */
+} NlexLazyDfa;
+
+/* The cache of nh, made on the first call (and again if the handle is
+ * used with another scanner); nlex_destroy() frees it. Keeping it in the
+ * handle lets handles be used from different threads at the same time.
+ */
+NlexLazyDfa * nlex_lazy_dfa_of(NlexHandle * nh, const NlexNfaDesc * nfa, size_t budget);
+
+uint32_t nlex_lazy_dfa_start(NlexHandle * nh, NlexLazyDfa * ld);
+uint32_t nlex_lazy_dfa_compute(
+	NlexHandle * nh, NlexLazyDfa * ld, uint32_t s, unsigned int cls);
+void     nlex_lazy_dfa_free(NlexLazyDfa * ld);
+
+/* The state entered from s on reading ch (0 if no rule can continue) */
+static inline uint32_t
+	nlex_lazy_dfa_next(NlexHandle * nh, NlexLazyDfa * ld, uint32_t s, int ch)
+{
+	unsigned int cls = ld->nfa->classmap[(unsigned char) ch];
+	uint32_t     t   = ld->trans[(size_t) s * ld->nfa->nclasses + cls];
+
+	if(t == NLEX_LAZY_DFA_UNKNOWN)
+		t = nlex_lazy_dfa_compute(nh, ld, s, cls);
+
+	return t;
+}
+
+#endif
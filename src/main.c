@@ -9,12 +9,87 @@
 
 #include <memory.h>
 
+#include "dfa.h"
 #include "error.h"
 #include "fastkeywords.h"
+#include "kinds.h"
+#include "kwsplit.h"
 #include "read.h"
 #include "tree.h"
 #include "plot.h"
 
+/* The loop of the tstack/nstack simulation; the code for the states (the
+ * switch or the jump table) goes in between.
+ */
+static void nlg_gen_nfa_loop_head(void)
+{
+	fprintf(fpout,
+			"while(!nlex_nstack_is_empty(nh)) {\n");
+
+#ifdef NLXDEBUG
+	fprintf(fpout,
+				"if(nh->buf && nh->bufptr >= nh->buf)\n" // TODO is the first `nh->buf` needed?
+					"fprintf(stderr, "
+						"\"nstack after the iteration that read %%d ('%%c'):\\n\", nlex_last(nh), nlex_last(nh));\n"
+				"else\n"
+					"fprintf(stderr, \"nstack:\\n\");\n"
+
+				"nlex_nstack_dump(nh);\n");
+#endif
+
+	fprintf(fpout,
+				"nlex_swap_t_n_stacks(nh);\n"
+				"assert(nlex_nstack_is_empty(nh));\n"
+				"if(!nlex_tstack_is_empty(nh)) {\n"
+					"ch = %s(nh); ch_set = 1;\n"
+					"%s"
+				"}\n"
+				
+				/* We need to move on even if the input has ended (ch == 0 || ch == EOF)
+				 * since the stacks can have states that do not need any input (like
+				 * the states to select an action.
+				 */
+				
+				"unsigned int hiprio_act_this_iter = UINT_MAX;\n"
+				"while(!nlex_tstack_is_empty(nh)) {\n"
+					"assert(ch_set);\n"
+					"nh->curstate = nlex_tstack_pop(nh);\n"
+					"if(nh->curstate == 0) continue;\n",
+			binary_input? "nlex_next_byte": "nlex_next",
+			NAN_HASH_STEP);
+}
+
+static void nlg_gen_reserve_states(NanTreeNode * troot)
+{
+	NanTreeNodeId maxid = 0;
+	size_t        count = 0;
+
+	nan_tree_unvisit(troot);
+	nan_tree_count_states(troot, &maxid, &count);
+
+	fprintf(fpout, "nlex_reserve_states(nh, %u, %zu);\n", maxid, count);
+}
+
+static void nlg_gen_nfa_loop_tail(void)
+{
+	/* The pushes register the actions (hiprio_act_this_iter), so the token
+	 * ends at the character just read.
+	 */
+	fprintf(fpout,
+				"} /* end while tstack */\n"
+				"assert(nlex_tstack_is_empty(nh));\n"
+
+				"if(hiprio_act_this_iter != UINT_MAX) {\n"
+					"nh->last_accepted_state = hiprio_act_this_iter;\n"
+					"nh->curtoklen = nh->bufptr - nh->buf - nh->curtokpos + 1;\n"
+					"%s"
+				"}\n"
+				// TODO REM
+				"//if(ch == EOF || ch == '\\0') { assert(nlex_nstack_is_empty(nh)); break; }\n" // TODO done above too. Why twice?
+			"} /* end while nstack */\n",
+			NAN_HASH_SAVE);
+}
+
 int main(int argc, char * argv[])
 {
 	FILE * fpin = stdin;
@@ -24,31 +99,110 @@ int main(int argc, char * argv[])
 	bool do_consume_callback = true;
 	char * function_header = NULL;
 	char * function_epilogue = NULL;
+
+	/* Emit `void NAME(NlexHandle * nh)` around the scanner; all its state
+	 * is in nh or in locals, and its tables are read-only, so it can run on
+	 * different handles in different threads (see batch.h).
+	 */
+	char * function_name = NULL;
+
+	/* Emit `size_t NAME(NlexHandle * nh, NlexToken * out, size_t cap)`,
+	 * which stores up to cap tokens in out per call instead of running the
+	 * action of one; the actions name the kinds of the tokens (see kinds.h).
+	 */
+	char * batch_name = NULL;
 	
-	// XXX Implemented and tested on 2023-04-07; no performance gain because:
-	// 1) The current implementation was already using nested ifs to reduce comparison
-	// 2) Since label-as-value works only in the local scope, it's impossible to
-	//    put the table as a global constant, resulting in init every time (memcpy)
-	// 3) The table is large, just to allocate NULLs that are the result of action
-	//    nodes which are not to be considered?
-	//    - NOTE: additionally, when the tree is simplified, the count of nodes
-	//            decreases, but the numbering is kept to preserve priorities.
-	//            (TODO do tree renumbering preserving the order)
+	// XXX Implemented and tested on 2023-04-07; there was no performance gain
+	// then because the table was a local array, initialized on every call,
+	// and sparse (action nodes and the gaps left by simplification). It is
+	// now a function-local static table indexed by the dense state ids (see
+	// nan_tree_renumber()).
 	bool use_jmptab = false;
 
+	/* Keyword rules looked up after the rule that also matches them (see
+	 * kwsplit.h) instead of being part of the automaton.
+	 */
+	bool split_keywords = false;
+
+	/* Emit a deterministic scanner instead of simulating the tree (one
+	 * live state per byte).
+	 */
+	bool use_dfa = false;
+	bool dfa_minimize = true;
+	bool dfa_tables = false; /* Static tables and a fixed driver loop */
+	bool dfa_direct = false; /* A label per state instead of dispatching */
+	bool dfa_lazy = false; /* States built and cached at runtime */
+	bool dfa_bitpar = false; /* No DFA; the NFA state set as a bit vector */
+	size_t dfa_max_states = 0; /* The rest is simulated as NFA; 0 for no limit */
+	bool dfa_equiv_classes = true; /* Transitions over byte classes */
+	bool dfa_parallel = false; /* The whole input tokenized by threads first */
+	bool dfa_resync_nl = false; /* Threads guess token starts after newlines */
+
 	if(argc > 1) {
 		int i = 0;
 	
 		while(++i < argc) {
 			if(0 == strcmp(argv[i], "--fastkeywords")) {
-				// TODO FIXME
-				nlex_die("fastkeywords is disabled because the generated code does not make sure the buffer is long enough before accessing it using `nh->buf[nh->curtokpos + n]`.");
-			
 				clopt_fastkw = true;
 			}
+			else if(0 == strcmp(argv[i], "--fastkeywords-phash")) {
+				/* Keyword selection by a perfect hash (with --fastkeywords) */
+				fastkeywords_use_phash = true;
+			}
+			else if(0 == strcmp(argv[i], "--split-keywords")) {
+				split_keywords = true;
+			}
+			else if(0 == strcmp(argv[i], "--dfa")) {
+				use_dfa = true;
+			}
+			else if(0 == strcmp(argv[i], "--dfa-tables")) {
+				use_dfa    = true;
+				dfa_tables = true;
+			}
+			else if(0 == strcmp(argv[i], "--dfa-direct")) {
+				use_dfa    = true;
+				dfa_direct = true;
+			}
+			else if(0 == strcmp(argv[i], "--lazy-dfa")) {
+				use_dfa  = true;
+				dfa_lazy = true;
+			}
+			else if(0 == strcmp(argv[i], "--bit-parallel")) {
+				use_dfa    = true;
+				dfa_bitpar = true;
+			}
+			else if(0 == strcmp(argv[i], "--parallel")) {
+				use_dfa      = true;
+				dfa_parallel = true;
+			}
+			else if(0 == strcmp(argv[i], "--resync-at-newlines")) {
+				dfa_resync_nl = true;
+			}
+			else if(0 == strcmp(argv[i], "--dfa-max-states")) {
+				i++;
+				if(argc <= i)
+					nlex_die("No number given after --dfa-max-states.");
+
+				char * endptr;
+				dfa_max_states = strtoul(argv[i], &endptr, 10);
+				if(*endptr || dfa_max_states == 0)
+					nlex_die("Invalid number given after --dfa-max-states.");
+			}
+			else if(0 == strcmp(argv[i], "--no-minimize")) {
+				dfa_minimize = false;
+			}
+			else if(0 == strcmp(argv[i], "--no-equiv-classes")) {
+				dfa_equiv_classes = false;
+			}
 			else if(0 == strcmp(argv[i], "--no-simplify")) {
 				simplify = false;
 			}
+			else if(0 == strcmp(argv[i], "--binary")) {
+				binary_input = true;
+			}
+			else if(0 == strcmp(argv[i], "--token-hash")) {
+				token_hash = true;
+			}
 			else if(0 == strcmp(argv[i], "--no-consume-callback")) {
 				do_consume_callback = false;
 			}
@@ -58,6 +212,18 @@ int main(int argc, char * argv[])
 					nlex_die("No path given after --function-epilogue.");
 				function_epilogue = argv[i];
 			}
+			else if(0 == strcmp(argv[i], "--function")) {
+				i++;
+				if(argc <= i)
+					nlex_die("No name given after --function.");
+				function_name = argv[i];
+			}
+			else if(0 == strcmp(argv[i], "--scan-batch")) {
+				i++;
+				if(argc <= i)
+					nlex_die("No name given after --scan-batch.");
+				batch_name = argv[i];
+			}
 			else if(0 == strcmp(argv[i], "--function-header")) {
 				i++;
 				if(argc <= i)
@@ -98,10 +264,21 @@ int main(int argc, char * argv[])
 	// machine); it's assumed:
 	//  1) Keywords are of English lowercase letters only
 	//  2) The regex pattern for keywords represent a subset of IDs
-	//  3) The rule for IDs is present in the input and it is the last one
+	//  3) The rule for IDs is present in the input (the last rule with a
+	//     repetition that accepts every keyword; see nlg_fastkw_id_action())
 	//  4) The rule for IDs conforms to that of nguigen
+	// --split-keywords does the same without these assumptions (see kwsplit.h).
 	fastkeywords_init(clopt_fastkw);
 
+	if(function_name && function_header)
+		nlex_die("--function and --function-header are alternatives.");
+
+	if(batch_name && (function_name || function_header))
+		nlex_die("--scan-batch cannot be combined with --function or --function-header.");
+
+	if(batch_name && (clopt_fastkw || zstr2deterkw))
+		nlex_die("--scan-batch cannot be combined with --fastkeywords or --zstr2deterkw.");
+
 	NlexHandle *  nh;
 	nh = nlex_handle_new();
 	if(!nh)
@@ -109,11 +286,42 @@ int main(int argc, char * argv[])
 
 	nlex_init(nh, fpin, NULL);
 
+	NanTreeBuild tb;
+	nan_tree_build_init(&tb);
+
+	NanSplitKeywords splitkw;
+	nlg_split_keywords_init(&splitkw);
+
+	NanKinds kinds;
+	nlg_kinds_init(&kinds);
+
 	NanTreeNode troot;
-	const char * err = nlg_build_tree(&troot, nh);
+	const char * err = nlg_build_tree(&troot, nh, &tb);
 	if(err != NLEXERR_SUCCESS)
 		nlex_die(err);
 
+	nan_tree_flatten(&troot, &tb);
+
+	if(clopt_fastkw) {
+		nan_tree_number(&troot); // The priorities are those of the full rule set
+		idactnode = nlg_fastkw_id_action(&troot);
+		if(!idactnode)
+			nlex_die("--fastkeywords needs a rule with a repetition that accepts every keyword (the ID rule).");
+	}
+
+	if(batch_name) {
+		nlg_kinds_from_actions(&troot, &kinds);
+		do_consume_callback = false; /* The caller has the tokens anyway */
+	}
+
+	if(split_keywords) {
+		if(clopt_fastkw || zstr2deterkw)
+			nlex_die("--split-keywords cannot be combined with --fastkeywords or --zstr2deterkw.");
+
+		nan_tree_number(&troot); // The priorities are those of the full rule set
+		nlg_split_keywords(&troot, &splitkw);
+	}
+
 	if(simplify) {
 		nan_tree_number(&troot); // do it first to preserve priorities
 		nan_tree_simplify(&troot);
@@ -126,6 +334,48 @@ int main(int argc, char * argv[])
 	nan_tree_unvisit(&troot);
 	nan_assert_all_nodes_have_id(&troot);
 
+	nan_tree_renumber(&troot);
+
+	nan_tree_unvisit(&troot);
+	nan_tree_mark_accepts(&troot);
+
+	if(dfa_resync_nl && !dfa_parallel)
+		nlex_die("--resync-at-newlines is only for --parallel.");
+
+	if(binary_input && (clopt_fastkw || zstr2deterkw || dfa_lazy || dfa_bitpar || dfa_parallel))
+		nlex_die("--binary cannot be combined with --fastkeywords, --zstr2deterkw, --lazy-dfa, --bit-parallel or --parallel.");
+
+	/* Those find the tokens with code of their own. */
+	if(token_hash && (clopt_fastkw || zstr2deterkw || dfa_parallel))
+		nlex_die("--token-hash cannot be combined with --fastkeywords, --zstr2deterkw or --parallel.");
+
+	NanNfa nfa;
+	NanDfa dfa;
+
+	if(use_dfa) {
+		if(zstr2deterkw || use_jmptab)
+			nlex_die("--dfa cannot be combined with --zstr2deterkw or --x-use-jump-table.");
+
+		if(dfa_tables + dfa_direct + dfa_lazy + dfa_bitpar > 1)
+			nlex_die("--dfa-tables, --dfa-direct, --lazy-dfa and --bit-parallel are alternatives.");
+
+		if(dfa_parallel && (dfa_tables || dfa_direct || dfa_lazy || dfa_bitpar ||
+		                    dfa_max_states || clopt_fastkw))
+			nlex_die("--parallel cannot be combined with the other --dfa variants, --dfa-max-states or --fastkeywords.");
+
+		nan_nfa_construct(&nfa, &troot);
+
+		if(!dfa_lazy && !dfa_bitpar) {
+			nan_dfa_construct(&dfa, &nfa, dfa_equiv_classes, dfa_max_states);
+
+			if(dfa_minimize)
+				nan_dfa_minimize(&dfa);
+
+			if(dfa_max_states)
+				nan_dfa_fallback_report(&dfa, &nfa, stderr);
+		}
+	}
+
 	fpout = stdout;
 
 	/* BEGIN Code Generation */
@@ -143,17 +393,35 @@ int main(int argc, char * argv[])
 	if(function_header) {
 		fprintf(fpout, "%s\n{\n", function_header);
 	}
+	else if(function_name) {
+		fprintf(fpout, "void %s(NlexHandle * nh)\n{\n", function_name);
+	}
+	else if(batch_name) {
+		nlg_kinds_to_code(&kinds, batch_name, fpout);
+
+		/* The scanner of one token, run until out is full or no token is
+		 * found (curtoklen is left 0 then, as after a single scan).
+		 */
+		fprintf(fpout,
+			"size_t %s(NlexHandle * nh, NlexToken * out, size_t cap)\n"
+			"{\n"
+			"size_t nout = 0;\n"
+			"while(nout < cap) {\n"
+				"nh->curtoklen = 0;\n"
+				"nh->last_accepted_state = 0;\n",
+			batch_name);
+	}
 
 	// Can't move out of the fun to global scope because only local
-	// addresses can be taken.
+	// addresses can be taken; being static, it is initialized only once.
+	// Slot 0 is never dispatched on (nh->curstate == 0 is skipped).
 	if(use_jmptab) {
-		nan_tree_unvisit(&troot);
 		Jmptab jmptabinfo = nan_tree_istates_to_code_mkjmptab(&troot);
 		char ** jmptab = jmptabinfo.arr;
 		size_t jmptabsiz = jmptabinfo.len;
-		fprintf(fpout, "void * jmptab[%zu] = { ", jmptabsiz);
+		fprintf(fpout, "static const void * const jmptab[%zu] = { ", jmptabsiz);
 		for(size_t i = 0; i < jmptabsiz; i++)
-			fprintf(fpout, "%s, ", jmptab[i]? jmptab[i]: "NULL");
+			fprintf(fpout, "%s, ", jmptab[i]? jmptab[i]: "&&endjmp");
 		fprintf(fpout, "};\n");
 
 		for(size_t i = 0; i < jmptabsiz; i++)
@@ -161,11 +429,6 @@ int main(int argc, char * argv[])
 		free(jmptab);
 	}
 
-// TODO FIXME action nodes should not be expanded into the same loop where regular states are compared. Put them outside the scanner loop so that less comparisons are made.
-// NOTE: Commits made on or just before 2021-05-22 do
-// something similar. Check. I think splitting the loop would
-// be a further improvement.
-
 	if(zstr2deterkw) {
 		fprintf(fpout,
 				"nh->curstate = %d;\n",
@@ -179,18 +442,34 @@ int main(int argc, char * argv[])
 			"while(!nlex_end_of_input(nh) && nh->last_accepted_state == 0 && !reject) {\n"
 				"char ch = nlex_next(nh);\n"
 				"size_t ch_read_after_accept = 0;\n" /* TODO REM? */
-				"int lastmatchat = -1;\n");
+				"NlexOffset lastmatchat = -1;\n");
+	}
+	else if(dfa_parallel) {
+		/* Opens the block of the dispatch of a stored token */
+		nan_dfa_to_code_parallel(&dfa, dfa_resync_nl);
+	}
+	else if(use_dfa) {
+		fprintf(fpout,
+			"if(!nlex_end_of_input(nh)) {\n"
+				"%s ch = 0;\n"
+				"%s"
+				"nh->curtokpos = nh->bufptr - nh->buf + 1;\n"
+				"nh->curtoklen = 0;\n"
+				"nh->last_accepted_state = 0;\n",
+			binary_input? "int": "char",
+			token_hash? "size_t tokhash = NLEX_HASH_INIT;\n": "");
 	}
 	else {
 		fprintf(fpout,
 			"if(!nlex_end_of_input(nh)) {\n"
-				"char ch = 0;\n"
+				"%s ch = 0;\n"
+				"%s"
 				"_Bool ch_set = 0;\n"
-				"size_t ch_read_after_accept = 0;\n"
-				"int lastmatchat = -1;\n"
 				// TODO why aren't these part of reset_states()?
 				"nh->curtokpos = nh->bufptr - nh->buf + 1;\n"
-				"nh->curtoklen = 0;\n");
+				"nh->curtoklen = 0;\n",
+			binary_input? "int": "char",
+			token_hash? "size_t tokhash = NLEX_HASH_INIT;\n": "");
 	}
 
 	if(fastkeywords_enabled) {
@@ -199,13 +478,15 @@ int main(int argc, char * argv[])
 			"_Bool couldbeid = 0;\n"
 			// 'v' not accepted because it could start v, vh and vtop lines (ngg)
 			"if( islower(ch = nlex_next(nh)) && ch != 'v' ) {\n"
-				"while(islower(ch)) { nh->curtoklen++; ch = nlex_next(nh); }\n"
+				// The run is scanned over the buffered bytes first (see nlex_skip_lower())
+				"while(islower(ch)) { nh->curtoklen += 1 + nlex_skip_lower(nh); ch = nlex_next(nh); }\n"
 				"\n"
 				"/* Maybe a keyword ended now, or it is an ID and it continues, or it is something like L\"wcharstr\" */\n"
-				"int curtoklenbak = nh->curtoklen;\n"
+				"NlexOffset curtoklenbak = nh->curtoklen;\n"
 				"while(isalpha(ch) || isdigit(ch) || ch == '_' || ch == '-') { nh->curtoklen++; ch = nlex_next(nh); }\n"
 				"couldbeid = (ch != '\\'' && ch != '\\\"' && ch != '='); /* e.g.: L\"wcharstr\", sum= */\n"
 				"couldbekw = couldbeid && (nh->curtoklen == curtoklenbak); /* No trailing quotes and no id-exclusive chars after keyword match */\n"
+				"nh->bufptr = nh->buf + nh->curtokpos + nh->curtoklen - 1; /* Unread the char after the token */\n"
 
 				"if(couldbeid && !couldbekw) {\n");
 					nlg_gen_fastkw_onid(&troot);
@@ -213,6 +494,8 @@ int main(int argc, char * argv[])
 				"} else if(couldbekw) {\n");
 		if(fastkeywords_use_strcmp)
 			nlg_gen_fastkw_selection_strcmp(&troot);
+		else if(fastkeywords_use_phash)
+			nlg_gen_fastkw_selection_phash(&troot);
 		else
 			nlg_gen_fastkw_selection_trie(&troot);
 		fprintf(fpout,
@@ -222,84 +505,79 @@ int main(int argc, char * argv[])
 				"}\n");
 
 		fprintf(fpout,
+			"} else if(nlex_end_of_input(nh)) { /* Nothing left; the NFA code must not read on */\n"
+				"goto after_fastkw;\n"
 			"} else { /* Read only one char and it wasn't a fastkeyword/id starter */\n"
 				"nh->bufptr = nh->buf + nh->curtokpos - 1;\n"
 			"}\n");
 	}
 
-	if(!zstr2deterkw) {
-		fprintf(fpout,
-				"nlex_reset_states(nh);\n"
-				"nlex_nstack_push(nh, %d);\n",
-				troot.id);
-		fprintf(fpout,
-				"while(!nlex_nstack_is_empty(nh)) {\n");
+	if(use_dfa) {
+		if(dfa_parallel)
+			; /* Done by nlex_par_scan() */
+		else if(dfa_lazy)
+			nan_nfa_to_code_lazy(&nfa);
+		else if(dfa_bitpar)
+			nan_nfa_to_code_bitpar(&nfa);
+		else if(dfa_tables)
+			nan_dfa_to_code_table(&dfa);
+		else if(dfa_direct)
+			nan_dfa_to_code_direct(&dfa);
+		else
+			nan_dfa_to_code_switch(&dfa);
 
-	#ifdef NLXDEBUG
-		fprintf(fpout,
-					"if(nh->buf && nh->bufptr >= nh->buf)\n" // TODO is the first `nh->buf` needed?
-						"fprintf(stderr, "
-							"\"nstack after the iteration that read %%d ('%%c'):\\n\", nlex_last(nh), nlex_last(nh));\n"
-					"else\n"
-						"fprintf(stderr, \"nstack:\\n\");\n"
+		if(!dfa_lazy && !dfa_bitpar && dfa.nfallbacks) {
+			nlg_gen_reserve_states(&troot);
+			nan_dfa_fallback_to_code(&dfa, &nfa);
+			nlg_gen_nfa_loop_head();
 
-					"nlex_nstack_dump(nh);\n");
-	#endif
+			nan_tree_unvisit(&troot);
+			fprintf(fpout, "switch(nh->curstate) {\n");
+			nan_tree_istates_to_code_switch(&troot);
+			fprintf(fpout, "}\n");
 
+			nlg_gen_nfa_loop_tail();
+			fprintf(fpout,
+				"} /* endif dfa_fallback */\n");
+		}
+	}
+	else if(!zstr2deterkw) {
+		nlg_gen_reserve_states(&troot);
 		fprintf(fpout,
-					"nlex_swap_t_n_stacks(nh);\n"
-					"assert(nlex_nstack_is_empty(nh));\n"
-					"if(!nlex_tstack_is_empty(nh)) {\n"
-						"ch = nlex_next(nh); ch_set = 1; ch_read_after_accept++;"
-					"}\n"
-					
-					/* We need to move on even if the input has ended (ch == 0 || ch == EOF)
-					 * since the stacks can have states that do not need any input (like
-					 * the states to select an action.
-					 */
-					
-					"unsigned int hiprio_act_this_iter = UINT_MAX;\n"
-					"while(!nlex_tstack_is_empty(nh)) {\n"
-						"assert(ch_set);\n"
-						"size_t nstack_top_bak = nh->nstack_top;\n"
-						"nh->curstate = nlex_tstack_pop(nh);\n"
-						"if(nh->curstate == 0) continue;\n");
+				"nlex_reset_states(nh);\n"
+				"nlex_nstack_push(nh, %d);\n",
+				troot.id);
+		nlg_gen_nfa_loop_head();
 	}
 
+	if(!use_dfa) {
 #ifdef NLXDEBUG
-	fprintf(fpout,
-					"fprintf(stderr, \"curstate = %%d\\n\", nh->curstate);\n");
+		fprintf(fpout,
+						"fprintf(stderr, \"curstate = %%d\\n\", nh->curstate);\n");
 #endif
 
-	nan_tree_unvisit(&troot);
+		nan_tree_unvisit(&troot);
 	
-	if(!use_jmptab) {
-		//nan_tree_istates_to_code(&troot, false);
-		fprintf(fpout, "switch(nh->curstate) {\n");
-		nan_tree_istates_to_code_switch(&troot);
-		fprintf(fpout, "}\n");
-	}
-	else {
-		fprintf(fpout, "assert(jmptab[nh->curstate]);\n"); // TODO REM or make debug-only
-		fprintf(fpout, "goto *(jmptab[nh->curstate]);\n");
+		if(!use_jmptab) {
+			//nan_tree_istates_to_code(&troot, false);
+			fprintf(fpout, "switch(nh->curstate) {\n");
+			nan_tree_istates_to_code_switch(&troot);
+			fprintf(fpout, "}\n");
+		}
+		else {
+			fprintf(fpout, "assert(jmptab[nh->curstate]);\n"); // TODO REM or make debug-only
+			fprintf(fpout, "goto *(jmptab[nh->curstate]);\n");
 
-		nan_tree_istates_to_code_jmp(&troot);
-		fprintf(fpout, "endjmp:\n");
-	}
+			nan_tree_istates_to_code_jmp(&troot);
+			fprintf(fpout, "endjmp:\n");
+		}
 	
-	if(zstr2deterkw) {
-		// lastmatchat set during the node code generation
-	}
-	else {
-		fprintf(fpout,
-						"if(nh->nstack_top != nstack_top_bak) lastmatchat = (nh->bufptr - nh->buf);\n"
-					"} /* end while tstack */\n"
-					"assert(nlex_tstack_is_empty(nh));\n"
-
-					"if(hiprio_act_this_iter != UINT_MAX) { nh->last_accepted_state = hiprio_act_this_iter; } \n"
-					// TODO REM
-					"//if(ch == EOF || ch == '\\0') { assert(nlex_nstack_is_empty(nh)); break; }\n" // TODO done above too. Why twice?
-				"} /* end while nstack */\n");
+		if(zstr2deterkw) {
+			// lastmatchat set during the node code generation
+		}
+		else {
+			nlg_gen_nfa_loop_tail();
+		}
 	}
 
 #ifdef NLXDEBUG
@@ -311,32 +589,80 @@ int main(int argc, char * argv[])
 	nan_tree_unvisit(&troot);
 
 	fprintf(fpout,
-			"if(nh->last_accepted_state != 0) {\n"
+			"if(nh->last_accepted_state != 0) {\n");
+
+	/* Everything else sets curtoklen upon reaching an accepting state. */
+	if(zstr2deterkw) {
+		fprintf(fpout,
 				// TODO rem ch_read_after_accept if it'll always be 0
-				"nh->curtoklen = lastmatchat - nh->curtokpos - ch_read_after_accept + 1;\n"
+				"nh->curtoklen = lastmatchat - nh->curtokpos - ch_read_after_accept + 1;\n");
+	}
+
+	fprintf(fpout,
 				"assert(nh->curtoklen > 0);\n"
 				"assert(nh->curtokpos >= 0);\n"
-				"nh->bufptr = nh->buf + nh->curtokpos + nh->curtoklen - 1; /* means backtracking if there was a longer partial match (resetting bufptr is needed in every case though) */"
+				"nh->bufptr = nh->buf + nh->curtokpos + nh->curtoklen - 1; /* means backtracking if there was a longer partial match (resetting bufptr is needed in every case though) */\n");
+
+	if(batch_name)
+		fprintf(fpout, "unsigned int kind = 0;\n");
+
+	fprintf(fpout,
 				"switch(nh->last_accepted_state) {\n");
-	nan_tree_astates_to_code(&troot, do_consume_callback);
+	nan_tree_astates_to_code(&troot, &splitkw, do_consume_callback);
 	fprintf(fpout,
 				"}\n");
 
 	if(fastkeywords_enabled)
 		fprintf(fpout, "after_fastkw:\n");
 
+	if(splitkw.count)
+		fprintf(fpout, NLG_KWSPLIT_LABEL ": ;\n");
+
+	if(batch_name) {
+		fprintf(fpout,
+				"if(kind) {\n"
+					"out[nout].pos = nh->buf_discarded + nh->curtokpos;\n"
+					"out[nout].len = nh->curtoklen;\n"
+					"out[nout].act = kind;\n"
+					"nout++;\n"
+				"}\n");
+	}
+
 	fprintf(fpout,
 			"} /* endif last_accepted_state */\n");
 	fprintf(fpout, "} /* endif not end of input */ \n");
 
-	if(function_header) {
+	if(function_header || function_name) {
 		if(function_epilogue)
 			fprintf(fpout, "%s\n", function_epilogue);
 
 		fprintf(fpout, "}\n");
 	}
+	else if(batch_name) {
+		fprintf(fpout,
+			"if(nh->curtoklen == 0) break;\n"
+			"} /* end while nout < cap */\n");
+
+		if(function_epilogue)
+			fprintf(fpout, "%s\n", function_epilogue);
+
+		fprintf(fpout,
+			"return nout;\n"
+			"}\n");
+	}
 	/* END Code Generation */
 
+	if(use_dfa) {
+		if(!dfa_lazy && !dfa_bitpar)
+			nan_dfa_destruct(&dfa);
+
+		nan_nfa_destruct(&nfa);
+	}
+
+	nlg_kinds_free(&kinds);
+	nlg_split_keywords_free(&splitkw);
+	nan_tree_build_free(&tb);
+
 	nlex_handle_destruct(nh);
 	free(nh);
 
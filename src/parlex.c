@@ -0,0 +1,297 @@
+/* parlex.c
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parlex.h"
+
+/* The part of the input a thread scans, and what it found there */
+typedef struct NlexParChunk {
+	const NlexDfaDesc * dfa;
+	const char        * buf;
+	size_t              len;
+	unsigned char       endbyte;
+
+	size_t              start;    /* Guessed token start */
+	size_t              end;      /* Tokens starting before this are kept */
+
+	NlexToken         * tokens;
+	size_t              count;
+	size_t              allocsiz;
+	size_t              stop;     /* Where the last token kept ends */
+	_Bool               failed;   /* No rule matches at stop */
+} NlexParChunk;
+
+/* The longest match at pos, read the way the table-driven scanner reads
+ * it: the byte after buf[len - 1] is endbyte, and the scan ends there.
+ * Returns the length (0 if nothing matches) and the action in *act.
+ */
+static size_t nlex_par_match(const NlexDfaDesc * dfa, const char * buf,
+	size_t len, unsigned char endbyte, size_t pos, uint32_t * act)
+{
+	uint32_t s    = dfa->start;
+	size_t   cur  = pos;
+	size_t   mlen = 0;
+
+	*act = 0;
+
+	for(;;) {
+		if(dfa->acc[s]) {
+			*act = dfa->acc[s];
+			mlen = cur - pos;
+		}
+
+		if(cur > len) /* endbyte read */
+			break;
+
+		unsigned char b = (cur < len)? (unsigned char) buf[cur]: endbyte;
+		cur++;
+
+		s = dfa->trans[(size_t) s * dfa->nclasses + dfa->classmap[b]];
+		if(!s)
+			break;
+	}
+
+	return mlen;
+}
+
+static void nlex_par_append(NlexToken ** tokens, size_t * count,
+	size_t * allocsiz, size_t pos, size_t len, uint32_t act)
+{
+	if(*count == *allocsiz) {
+		*allocsiz = *allocsiz? *allocsiz * 2: 256;
+		*tokens   = nlex_realloc(NULL, *tokens, sizeof(NlexToken) * *allocsiz);
+	}
+
+	NlexToken * t = &(*tokens)[(*count)++];
+	t->pos = pos;
+	t->len = len;
+	t->act = act;
+}
+
+static void * nlex_par_chunk_scan(void * arg)
+{
+	NlexParChunk * c = arg;
+	size_t         p = c->start;
+
+	while(p < c->end) {
+		uint32_t act;
+		size_t   m = nlex_par_match(c->dfa, c->buf, c->len, c->endbyte, p, &act);
+
+		if(m == 0 || act == 0) {
+			c->failed = 1;
+			break;
+		}
+
+		nlex_par_append(&c->tokens, &c->count, &c->allocsiz, p, m, act);
+		p += m;
+	}
+
+	c->stop = p;
+	return NULL;
+}
+
+size_t nlex_par_tokenize(const NlexDfaDesc * dfa,
+	const char * buf, size_t len, unsigned char endbyte,
+	size_t nthreads, size_t min_chunk, NlexToken ** tokens)
+{
+	if(nthreads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpus > 0)? (size_t) ncpus: 1;
+	}
+
+	if(min_chunk == 0)
+		min_chunk = 1;
+
+	/* The position len (where only endbyte is left) can start a token too */
+	size_t total = len + 1;
+	size_t n     = total / min_chunk;
+
+	if(n > nthreads)
+		n = nthreads;
+	if(n == 0)
+		n = 1;
+
+	NlexParChunk * chunks  = nlex_calloc_internal(n, sizeof(NlexParChunk));
+	pthread_t    * threads = nlex_calloc_internal(n, sizeof(pthread_t));
+	_Bool        * started = nlex_calloc_internal(n, sizeof(_Bool));
+
+	for(size_t k = 0; k < n; k++) {
+		NlexParChunk * c = &chunks[k];
+		size_t nominal = total / n * k;
+
+		c->dfa     = dfa;
+		c->buf     = buf;
+		c->len     = len;
+		c->endbyte = endbyte;
+		c->start   = nominal;
+
+		if(k > 0 && dfa->resync_nl) {
+			/* nominal - 1 so that a chunk starting right after a newline
+			 * keeps its start.
+			 */
+			const char * nl = memchr(buf + nominal - 1, '\n', len - (nominal - 1));
+			c->start = nl? (size_t) (nl - buf) + 1: total;
+		}
+
+		if(k > 0)
+			chunks[k - 1].end = c->start;
+	}
+
+	chunks[n - 1].end = total;
+
+	for(size_t k = 1; k < n; k++)
+		started[k] = (0 == pthread_create(&threads[k], NULL,
+			nlex_par_chunk_scan, &chunks[k]));
+
+	/* The first guess is right by definition. */
+	nlex_par_chunk_scan(&chunks[0]);
+
+	for(size_t k = 1; k < n; k++) {
+		if(started[k])
+			pthread_join(threads[k], NULL);
+		else
+			nlex_par_chunk_scan(&chunks[k]);
+	}
+
+	/* Walk the true token boundaries from the start. At each chunk, the
+	 * speculative tokens are taken from the first one that starts on a true
+	 * boundary (from there on, both streams are the same); the tokens
+	 * before that are scanned again here.
+	 */
+	NlexToken * out      = chunks[0].tokens;
+	size_t      count    = chunks[0].count;
+	size_t      allocsiz = chunks[0].allocsiz;
+	size_t      e        = chunks[0].stop;
+	_Bool       failed   = chunks[0].failed;
+
+	for(size_t k = 1; k < n && !failed; k++) {
+		NlexParChunk * c = &chunks[k];
+		size_t         j = 0;
+
+		while(!failed && e < c->end) {
+			while(j < c->count && c->tokens[j].pos < e)
+				j++;
+
+			if(j < c->count && c->tokens[j].pos == e) {
+				for(; j < c->count; j++)
+					nlex_par_append(&out, &count, &allocsiz,
+						c->tokens[j].pos, c->tokens[j].len, c->tokens[j].act);
+
+				e      = c->stop;
+				failed = c->failed;
+				break;
+			}
+
+			uint32_t act;
+			size_t   m = nlex_par_match(dfa, buf, len, endbyte, e, &act);
+
+			if(m == 0 || act == 0) {
+				failed = 1;
+				break;
+			}
+
+			nlex_par_append(&out, &count, &allocsiz, e, m, act);
+			e += m;
+		}
+	}
+
+	for(size_t k = 1; k < n; k++)
+		free(chunks[k].tokens);
+
+	if(!out)
+		out = nlex_malloc(NULL, sizeof(NlexToken));
+
+	free(chunks);
+	free(threads);
+	free(started);
+
+	*tokens = out;
+	return count;
+}
+
+void nlex_par_scan(NlexHandle * nh, const NlexDfaDesc * dfa)
+{
+	if(nh->tokens)
+		return;
+
+	if(nlex_is_streamed(nh) && !nh->eof_read) {
+		/* Everything is read in at once (without dropping anything for
+		 * stream_window, which cannot apply).
+		 */
+		size_t ptroff = nh->bufptr - nh->buf; /* Can be -1 */
+		size_t window = nh->stream_window;
+
+		nh->stream_window = 0;
+
+		do
+			nh->bufptr = nh->bufendptr;
+		while(nlex_refill(nh));
+
+		/* As nlex_next() leaves it after reading EOF, but for eof_read,
+		 * which is for nlex_par_next() to set
+		 */
+		nh->bufptr        = nh->buf + ptroff;
+		nh->eof_read      = 0;
+		nh->stream_window = window;
+	}
+
+	nh->tokens       = NULL;
+	nh->tokens_count = 0;
+	nh->tokens_next  = 0;
+
+	if(!nh->buf || (nlex_is_streamed(nh) && nh->eof_read)) {
+		nh->tokens = nlex_malloc(nh, sizeof(NlexToken));
+		return;
+	}
+
+	/* The nullchar at the end of the buffer (the input may have more of
+	 * them if it is a file) is not part of the input.
+	 */
+	size_t off = nh->bufptr - nh->buf + 1;
+	size_t len = nh->bufendptr - nh->buf - 1 - off;
+
+	nh->tokens_count = nlex_par_tokenize(dfa, nh->buf + off, len,
+		nlex_is_streamed(nh)? 0xFF: 0,
+		nh->par_nthreads,
+		nh->par_min_chunk? nh->par_min_chunk: NLEX_PAR_MIN_CHUNK,
+		&nh->tokens);
+
+	for(size_t i = 0; i < nh->tokens_count; i++)
+		nh->tokens[i].pos += off;
+}
+
+_Bool nlex_par_next(NlexHandle * nh)
+{
+	if(nh->tokens_next == nh->tokens_count) {
+		/* The sequential scanner would have read at least the byte that
+		 * nothing matches (the nullchar at the end, at most).
+		 */
+		nh->curtokpos = nh->bufptr - nh->buf + 1;
+		if(nh->bufptr + 1 < nh->bufendptr)
+			nh->bufptr++;
+
+		nh->curtoklen           = 0;
+		nh->last_accepted_state = 0;
+		return 0;
+	}
+
+	const NlexToken * t = &nh->tokens[nh->tokens_next++];
+
+	nh->curtokpos           = t->pos;
+	nh->curtoklen           = t->len;
+	nh->last_accepted_state = t->act;
+	nh->bufptr              = nh->buf + t->pos + t->len - 1;
+
+	/* The sequential scanner would have read EOF looking past this token. */
+	if(nlex_is_streamed(nh) && nh->tokens_next == nh->tokens_count &&
+	   t->pos + t->len >= (size_t) (nh->bufendptr - nh->buf - 1))
+		nh->eof_read = 1;
+
+	return 1;
+}
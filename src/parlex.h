@@ -0,0 +1,63 @@
+/* parlex.h
+ * This file is part of nlexgen, a lexer generator.
+ * Copyright (C) 2026 Nandakumar Edamana
+ * File started on 2026-10-17
+ */
+
+/* Runtime for the scanners generated with --parallel. The whole input is
+ * tokenized up front: it is cut into chunks, and each thread scans one of
+ * them on its own, guessing that a token starts at the beginning of the
+ * chunk (or just after its first newline). The guesses are then checked
+ * in order; where the true token boundary differs from the guessed one,
+ * the tokens are re-scanned one by one until the two streams meet again
+ * (which, for the usual grammars, happens within a token or two). Each
+ * call of the scanner then dispatches the next stored token.
+ *
+ * Link with -pthread.
+ */
+
+#ifndef _N96E_LEX_PARLEX_H
+#define _N96E_LEX_PARLEX_H
+
+#include <stdint.h>
+
+#include "read.h"
+
+/* Smallest chunk worth a thread; nh->par_min_chunk overrides if nonzero */
+#define NLEX_PAR_MIN_CHUNK (1 << 20)
+
+/* DFA emitted by nlexgen; see nan_dfa_to_code_parallel() */
+typedef struct NlexDfaDesc {
+	size_t           nstates;
+	size_t           nclasses;
+	uint32_t         start;
+	const uint8_t  * classmap;  /* Byte to class */
+	const uint32_t * trans;     /* nstates * nclasses; 0 is the dead state */
+	const uint32_t * acc;       /* Action id per state; 0 if none */
+	_Bool            resync_nl; /* Guess token starts after newlines */
+} NlexDfaDesc;
+
+/* Tokenizes buf[0..len) followed by endbyte (the byte the sequential
+ * scanner reads at the end: 0 for strings, 0xFF for EOF) with up to
+ * nthreads threads (0 for one per online CPU), none given less than
+ * min_chunk bytes. The tokens are those the sequential scanner would
+ * find, up to the first position where no rule matches. *tokens is
+ * always allocated; returns the count.
+ */
+size_t nlex_par_tokenize(const NlexDfaDesc * dfa,
+	const char * buf, size_t len, unsigned char endbyte,
+	size_t nthreads, size_t min_chunk, NlexToken ** tokens);
+
+/* Reads the rest of the input (if streamed) and tokenizes everything
+ * after bufptr into nh->tokens; does nothing if that is done already.
+ */
+void nlex_par_scan(NlexHandle * nh, const NlexDfaDesc * dfa);
+
+/* Makes the next stored token the current one, as if it had just been
+ * scanned (curtokpos, curtoklen, last_accepted_state and bufptr). Returns
+ * false, with curtoklen and last_accepted_state set to 0 and bufptr past
+ * the byte nothing matches, when none is left.
+ */
+_Bool nlex_par_next(NlexHandle * nh);
+
+#endif
@@ -4,6 +4,12 @@
  * Started on 2019-07-22
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "read.h"
 #include "tree.h"
 
@@ -28,28 +34,521 @@ NlexHandle * nlex_handle_new()
 	return nh;
 }
 
+/* buf is read in place; padded tells whether it has the pad */
+static void nlex_set_input(NlexHandle * nh, FILE * fpi, const char * buf, _Bool padded)
+{
+	size_t buflen = 0; /* With the nullchar */
+
+	nh->fp       = fpi;
+	nh->read_fn  = NULL;
+	nh->read_ctx = NULL;
+
+	nlex_free_retired(nh);
+	nlex_free_buf(nh);
+
+	if(buf) {
+		buflen = strlen(buf) + 1;
+
+		/* Casting is safe because the scanners do not write to it. */
+		nh->buf          = (char *) buf;
+		nh->buf_given    = 1;
+		nh->buf_unpadded = !padded;
+	}
+
+	nh->bufptr      = nh->buf - 1;
+	/* Makes nlex_next() read if streamed; just past the nullchar if not */
+	nh->bufendptr   = nh->buf + buflen;
+	nh->curtokpos   = -1;
+
+	nh->buf_discarded = 0;
+}
+
 void nlex_init(NlexHandle * nh, FILE * fpi, const char * buf)
 {
 	nlex_handle_construct(nh);
 	nh->on_error = nlex_onerror;
 	nh->buf_alloc_unit = NLEX_DEFT_BUF_ALLOC_UNIT;
 
-	/* These two assignments not put inside some branching because
-	 * the one that is not chosen has to be initialized to NULL
-	 * and these two will do that automatically.
+	nlex_set_input(nh, fpi, buf, 0);
+}
+
+void nlex_init_padded(NlexHandle * nh, const char * buf)
+{
+	nlex_init(nh, NULL, NULL);
+	nlex_set_input(nh, NULL, buf, 1);
+}
+
+void nlex_init_source(NlexHandle * nh,
+	size_t (*read_fn)(NlexHandle * nh, char * dst, size_t len), void * ctx)
+{
+	nlex_init(nh, NULL, NULL);
+
+	nh->read_fn  = read_fn;
+	nh->read_ctx = ctx;
+}
+
+void nlex_init_iov(NlexHandle * nh, const NlexNString * iov, size_t count)
+{
+	nlex_init(nh, NULL, NULL);
+
+	/* Only read */
+	nh->iov       = (NlexNString *) iov;
+	nh->iov_count = count;
+}
+
+void nlex_init_n(NlexHandle * nh, const char * buf, size_t len)
+{
+	nlex_init(nh, NULL, NULL);
+
+	nh->iov_single.buf = buf;
+	nh->iov_single.len = len;
+	nh->iov            = &nh->iov_single;
+	nh->iov_count      = 1;
+}
+
+_Bool nlex_init_mmap_fd(NlexHandle * nh, int fd)
+{
+	struct stat st;
+
+	if(fstat(fd, &st) != 0)
+		return 0;
+
+	if(!S_ISREG(st.st_mode)) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* Zero pages past the file for the nullchar and the pad; the rest of
+	 * the last page of the file is zeroed by the system too.
 	 */
-	nh->fp          = fpi;
-	/* Casting is safe because I know I don't misuse it. */
-	nh->buf         = (char *) buf;
+	size_t size   = st.st_size;
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	size_t maplen = (size + 1 + NLEX_BUF_PAD + pagesz - 1) / pagesz * pagesz;
 
-	nh->bufptr      = nh->buf - 1;
-	nh->bufendptr   = nh->buf; /* Makes nlex_next() read if fp != NULL */
-	nh->curtokpos   = -1;
+	char * base = mmap(NULL, maplen, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(base == MAP_FAILED)
+		return 0;
+
+	if(size && MAP_FAILED == mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0)) {
+		int err = errno;
+		munmap(base, maplen);
+		errno = err;
+		return 0;
+	}
+
+	madvise(base, maplen, MADV_SEQUENTIAL);
+
+	nlex_init(nh, NULL, NULL);
+
+	nh->buf        = base;
+	nh->buf_mapped = maplen;
+	nh->bufptr     = nh->buf - 1;
+	nh->bufendptr  = nh->buf + size + 1; /* Just past the nullchar */
+
+	return 1;
+}
+
+_Bool nlex_init_mmap(NlexHandle * nh, const char * path)
+{
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return 0;
+
+	/* The mapping stays after the close. */
+	_Bool ok = nlex_init_mmap_fd(nh, fd);
+	int   err = errno;
+
+	close(fd);
+	errno = err;
+
+	return ok;
+}
+
+void nlex_free_buf(NlexHandle * nh)
+{
+	if(nh->buf_mapped) {
+		munmap(nh->buf, nh->buf_mapped);
+	}
+	else if(nh->iov) {
+		free(nh->iov_side);
+
+		nh->iov               = NULL;
+		nh->iov_count         = 0;
+		nh->iov_seg           = 0;
+		nh->iov_off           = 0;
+		nh->iov_side          = NULL;
+		nh->iov_side_allocsiz = 0;
+	}
+	else if(!nh->buf_given) {
+		free(nh->buf);
+	}
+
+	nh->buf          = NULL;
+	nh->buf_mapped   = 0;
+	nh->buf_given    = 0;
+	nh->buf_unpadded = 0;
+	nh->buf_allocsiz = 0;
+}
+
+void nlex_reset(NlexHandle * nh, FILE * fpi, const char * buf)
+{
+	free(nh->tokens);
+	nh->tokens       = NULL;
+	nh->tokens_count = 0;
+	nh->tokens_next  = 0;
+
+	nh->curtoklen           = 0;
+	nh->eof_read            = 0;
+	nh->curstate            = 0;
+	nh->last_accepted_state = 0;
+
+	nlex_reset_states(nh);
+	nlex_set_input(nh, fpi, buf, 0);
+}
+
+void nlex_buf_reserve(NlexHandle * nh, size_t len)
+{
+	if(len + NLEX_BUF_PAD <= nh->buf_allocsiz)
+		return;
+
+	size_t allocsiz = nh->buf_allocsiz * 2;
+	if(allocsiz < len + NLEX_BUF_PAD)
+		allocsiz = len + NLEX_BUF_PAD;
+
+	char * oldbuf = nh->buf;
+	size_t used   = oldbuf? (size_t) (nh->bufendptr - oldbuf): 0;
+
+	if(!oldbuf || nh->stream_window) {
+		nh->buf = nlex_realloc(nh, oldbuf, allocsiz);
+	}
+	else {
+		nh->buf = nlex_malloc(nh, allocsiz);
+		memcpy(nh->buf, oldbuf, used);
+
+		nh->retired = nlex_realloc(nh, nh->retired,
+			sizeof(void *) * (nh->retired_count + 1));
+		nh->retired[nh->retired_count++] = oldbuf;
+	}
+
+	nh->buf_allocsiz = allocsiz;
+	nh->bufptr       = nh->buf + (nh->bufptr - oldbuf);
+	nh->bufendptr    = nh->buf + used;
+}
+
+void nlex_free_retired(NlexHandle * nh)
+{
+	for(size_t i = 0; i < nh->retired_count; i++)
+		free(nh->retired[i]);
+
+	free(nh->retired);
+	nh->retired       = NULL;
+	nh->retired_count = 0;
+}
+
+/* A block of an arena; a->blocks is the newest */
+typedef struct NlexArenaBlock {
+	struct NlexArenaBlock * prev;
+	size_t                  size; /* Of data */
+	max_align_t             data[];
+} NlexArenaBlock;
+
+void nlex_arena_grow(NlexHandle * nh, NlexArena * a, size_t size)
+{
+	if(size < NLEX_ARENA_BLOCK)
+		size = NLEX_ARENA_BLOCK;
+
+	NlexArenaBlock * b = nlex_malloc(nh, sizeof(NlexArenaBlock) + size);
+
+	b->prev = a->blocks;
+	b->size = size;
+
+	a->blocks = b;
+	a->ptr    = (char *) b->data;
+	a->left   = size;
+}
+
+void nlex_arena_rewind(NlexArena * a)
+{
+	NlexArenaBlock * b = a->blocks;
+
+	if(!b)
+		return;
+
+	for(NlexArenaBlock * prev = b->prev; prev; ) {
+		NlexArenaBlock * p = prev->prev;
+		free(prev);
+		prev = p;
+	}
+
+	b->prev = NULL;
+	a->ptr  = (char *) b->data;
+	a->left = b->size;
+}
+
+void nlex_arena_release(NlexArena * a)
+{
+	for(NlexArenaBlock * b = a->blocks; b; ) {
+		NlexArenaBlock * prev = b->prev;
+		free(b);
+		b = prev;
+	}
+
+	*a = nlex_arena_default();
+}
+
+void nlex_arena_reset(NlexHandle * nh)
+{
+	nlex_arena_rewind(&nh->arena);
+
+	for(size_t i = 0; i < nh->interned_allocsiz; i++)
+		nh->interned[i] = nlex_interned_default();
+	nh->interned_count = 0;
+}
+
+void nlex_arena_free(NlexHandle * nh)
+{
+	nlex_arena_release(&nh->arena);
+
+	free(nh->interned);
+	nh->interned          = NULL;
+	nh->interned_count    = 0;
+	nh->interned_allocsiz = 0;
+}
+
+/* Doubles the interning table (kept at most 3/4 full) */
+static void nlex_interned_grow(NlexHandle * nh)
+{
+	size_t         allocsiz = nh->interned_allocsiz? nh->interned_allocsiz * 2: NLEX_INTERN_MIN;
+	NlexInterned * tab = nlex_malloc(nh, sizeof(NlexInterned) * allocsiz);
+
+	for(size_t i = 0; i < allocsiz; i++)
+		tab[i] = nlex_interned_default();
+
+	for(size_t i = 0; i < nh->interned_allocsiz; i++) {
+		const NlexInterned * e = &nh->interned[i];
+		size_t               k;
+
+		if(!e->str)
+			continue;
+
+		for(k = e->hash & (allocsiz - 1); tab[k].str; k = (k + 1) & (allocsiz - 1));
+		tab[k] = *e;
+	}
+
+	free(nh->interned);
+	nh->interned          = tab;
+	nh->interned_allocsiz = allocsiz;
+}
+
+const char * nlex_intern_hashed(NlexHandle * nh, const char * s, size_t len, size_t hash)
+{
+	if((nh->interned_count + 1) * 4 > nh->interned_allocsiz * 3)
+		nlex_interned_grow(nh);
+
+	size_t mask = nh->interned_allocsiz - 1;
+
+	for(size_t k = hash & mask; ; k = (k + 1) & mask) {
+		NlexInterned * e = &nh->interned[k];
+
+		if(!e->str) {
+			char * copy = nlex_arena_take(nh, &nh->arena, len + 1);
+
+			memcpy(copy, s, len);
+			copy[len] = '\0';
+
+			e->str  = copy;
+			e->len  = len;
+			e->hash = hash;
+			nh->interned_count++;
+
+			return copy;
+		}
+
+		if(e->hash == hash && e->len == len && 0 == memcmp(e->str, s, len))
+			return e->str;
+	}
+}
+
+/* Room for len bytes at nh->iov_side, plus the pad */
+static void nlex_iov_side_reserve(NlexHandle * nh, size_t len)
+{
+	if(len + NLEX_BUF_PAD <= nh->iov_side_allocsiz)
+		return;
+
+	size_t allocsiz = nh->iov_side_allocsiz * 2;
+	if(allocsiz < len + NLEX_BUF_PAD)
+		allocsiz = len + NLEX_BUF_PAD;
+
+	char * side = nlex_realloc(nh, nh->iov_side, allocsiz);
+
+	if(nh->buf == nh->iov_side) {
+		nh->bufptr    = side + (nh->bufptr - nh->buf);
+		nh->bufendptr = side + (nh->bufendptr - nh->buf);
+		nh->buf       = side;
+	}
+
+	nh->iov_side          = side;
+	nh->iov_side_allocsiz = allocsiz;
+}
+
+/* Points buf at other memory, where the bytes from buf[from] on are at
+ * newbuf; positions move along as with nlex_discard().
+ */
+static void nlex_iov_rebase(NlexHandle * nh, char * newbuf, size_t from)
+{
+	size_t len = nh->bufendptr - nh->buf - from;
+
+	nh->buf           = newbuf;
+	nh->bufptr        = newbuf + len;
+	nh->bufendptr     = newbuf + len;
+	nh->curtokpos    -= from;
+	nh->buf_discarded += from;
+}
+
+/* nlex_refill() for segmented input. While the current token is in one
+ * segment, buf is that segment (up to NLEX_BUF_PAD bytes before its end,
+ * so that nlex_skip_lower() need not look out of it). Otherwise the token
+ * so far is copied to the side buffer, with the next bytes after it, a
+ * step at a time until a token starts well inside the segment again.
+ */
+static _Bool nlex_iov_refill(NlexHandle * nh)
+{
+	/* The byte before the current token is kept, as in nlex_refill() */
+	size_t end  = nh->bufendptr - nh->buf;
+	size_t keep = (nh->curtokpos > 1)? (size_t) nh->curtokpos - 1: 0;
+	if(keep > end)
+		keep = end;
+
+	size_t live = end - keep;
+
+	while(nh->iov_seg < nh->iov_count &&
+	      nh->iov_off == nh->iov[nh->iov_seg].len)
+	{
+		nh->iov_seg++;
+		nh->iov_off = 0;
+	}
+
+	const NlexNString * seg = (nh->iov_seg < nh->iov_count)?
+		&nh->iov[nh->iov_seg]: NULL;
+
+	if(seg) {
+		size_t inplace_end = (seg->len > NLEX_BUF_PAD)? seg->len - NLEX_BUF_PAD: 0;
+
+		/* The live bytes are the ones just before iov_off. */
+		if(nh->iov_off >= live && nh->iov_off < inplace_end) {
+			nlex_iov_rebase(nh, (char *) seg->buf + nh->iov_off - live, keep);
+
+			nh->bufendptr = (char *) seg->buf + inplace_end;
+			nh->iov_off   = inplace_end;
+			return 1;
+		}
+	}
+
+	if(nh->buf != nh->iov_side) {
+		nlex_iov_side_reserve(nh, live);
+		memcpy(nh->iov_side, nh->buf + keep, live);
+		nlex_iov_rebase(nh, nh->iov_side, keep);
+	}
+	else if(keep > nh->iov_side_allocsiz / 2) {
+		memmove(nh->buf, nh->buf + keep, live);
+		nlex_iov_rebase(nh, nh->buf, keep);
+	}
+
+	/* A small step, to be back in place soon after the token; the bytes
+	 * are copied once however long it is (the side buffer is compacted
+	 * only when half of it is behind).
+	 */
+	size_t n = 1;
+	if(seg) {
+		n = seg->len - nh->iov_off;
+		if(n > NLEX_IOV_STEP)
+			n = NLEX_IOV_STEP;
+	}
+
+	nlex_iov_side_reserve(nh, (nh->bufendptr - nh->buf) + n);
+
+	if(seg) {
+		memcpy(nh->bufptr, seg->buf + nh->iov_off, n);
+		nh->iov_off += n;
+	}
+	else {
+		*(nh->bufptr) = '\0';
+		nh->eof_read  = 1;
+	}
+
+	nh->bufendptr = nh->bufptr + n;
+	memset(nh->bufendptr, 0, NLEX_BUF_PAD);
+
+	return seg != NULL;
+}
+
+_Bool nlex_refill(NlexHandle * nh)
+{
+	if(nh->iov)
+		return nlex_iov_refill(nh);
+
+	_Bool  eof_read = 0;
+	size_t bytes_read = 0;
+	size_t want = nh->buf_alloc_unit;
+
+	/* The input before the current token is not looked at again; the
+	 * byte just before it is kept for nlex_last() after a backtrack.
+	 */
+	if(nh->stream_window && nh->curtokpos > 0 &&
+	   (size_t) nh->curtokpos > nh->stream_window)
+		nlex_discard(nh, nh->curtokpos - 1);
+
+	/* A regular file is read in whole by the first call (+1 to have the
+	 * room for the nullchar too).
+	 */
+	struct stat st;
+	if(nh->fp && !nh->buf && !nh->stream_window &&
+	   0 == fstat(fileno(nh->fp), &st) && S_ISREG(st.st_mode))
+	{
+		long pos = ftell(nh->fp);
+		if(pos >= 0 && st.st_size > pos && (size_t) (st.st_size - pos) >= want)
+			want = st.st_size - pos + 1;
+	}
+
+	/* This is the best place to check */
+	if(nh->fp && feof(nh->fp))
+		eof_read = 1;
+
+	size_t curlen = nh->bufendptr - nh->buf;
+	nlex_buf_reserve(nh, curlen + (eof_read? 1: want));
+
+	if(!eof_read) {
+		if(nh->read_fn) {
+			bytes_read = nh->read_fn(nh, nh->bufptr, want);
+			assert(bytes_read <= want);
+		}
+		else {
+			bytes_read = fread(nh->bufptr, 1, want, nh->fp);
+			if(ferror(nh->fp))
+				nh->on_error(nh, NLEX_ERR_READING);
+		}
+
+		/* Really important. The feof() check at the top fails to detect the end if the file size is a multiple of buf_alloc_unit and the previous read had consumed the last block, leaving nothing for this call to read. */
+		if(bytes_read == 0)
+			eof_read = 1;
+	}
+
+	if(eof_read) {
+		*(nh->bufptr) = '\0';
+		bytes_read    = 1;
+		nh->eof_read  = 1;
+	}
+
+	/* Points to the memory location next to the last character. */
+	nh->bufendptr = nh->bufptr + bytes_read;
+	memset(nh->bufendptr, 0, NLEX_BUF_PAD);
+
+	return !eof_read;
 }
 
-void nlex_onerror(NlexHandle * nh, NlexErr errno)
+void nlex_onerror(NlexHandle * nh, NlexErr err)
 {
-	switch(errno) {
+	switch(err) {
 	case NLEX_ERR_MALLOC:
 	case NLEX_ERR_REALLOC:
 		fprintf(stderr, "nlex: malloc()/realloc() error.\n");
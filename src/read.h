@@ -10,16 +10,42 @@
 #include <assert.h>
 #include <limits.h>
 #include <memory.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
+
 #include "error.h"
 #include "types.h"
 
 #define NLEX_DEFT_BUF_ALLOC_UNIT BUFSIZ
 
-// TODO make the latter number the maximum expected concurrent states
-#define NLEX_STATESTACK_ALLOC_UNIT 32
+/* Number of zero bytes kept allocated past bufendptr, so that the scanner
+ * can load up to this many bytes from any position in the buffer without
+ * checking the length first (see nlex_skip_lower()).
+ */
+#define NLEX_BUF_PAD 16
+
+/* Number of bytes copied to the side buffer at a time when the
+ * segmented input is read around a boundary (see nlex_init_iov())
+ */
+#define NLEX_IOV_STEP 64
+
+/* Smallest block the arena gets from malloc() (see nlex_arena_alloc()) */
+#define NLEX_ARENA_BLOCK 65536
+
+/* Alignment of what nlex_arena_alloc() returns */
+#define NLEX_ARENA_ALIGN _Alignof(max_align_t)
+
+/* Slots the interning table starts with; a power of two */
+#define NLEX_INTERN_MIN 256
+
+/* Start value of nlex_hash() */
+#define NLEX_HASH_INIT 2166136261u
 
 /* Because EOF can be any value and writing down a constant here can
  * cause confusion with EOF.
@@ -83,6 +109,81 @@ static inline void * nlex_realloc(NlexHandle * nh, void * ptr, size_t size)
 	return newptr;
 }
 
+/* Makes room for size bytes in a new block; see nlex_arena_take().
+ * As with nlex_malloc(), errors go to nh, which can be NULL.
+ */
+void nlex_arena_grow(NlexHandle * nh, NlexArena * a, size_t size);
+
+/* size bytes from the arena, not aligned */
+static inline char * nlex_arena_take(NlexHandle * nh, NlexArena * a, size_t size)
+{
+	if(size > a->left)
+		nlex_arena_grow(nh, a, size);
+
+	char * p = a->ptr;
+
+	a->ptr  += size;
+	a->left -= size;
+
+	return p;
+}
+
+/* Memory that lives until the arena is rewound or released, all of which
+ * is freed at once; no single block is freed. Taking it is a bump of a
+ * pointer, except when a new block is needed. An arena starts as
+ * nlex_arena_default(); the one of a handle is nh->arena.
+ */
+static inline void * nlex_arena_alloc(NlexHandle * nh, NlexArena * a, size_t size)
+{
+	size_t pad = -(uintptr_t) a->ptr & (NLEX_ARENA_ALIGN - 1);
+
+	/* New blocks start aligned. */
+	if(pad + size > a->left) {
+		nlex_arena_grow(nh, a, size);
+		pad = 0;
+	}
+
+	a->ptr  += pad;
+	a->left -= pad;
+
+	return nlex_arena_take(nh, a, size);
+}
+
+/* Frees all the blocks but the newest, which is taken from the start
+ * again.
+ */
+void nlex_arena_rewind(NlexArena * a);
+
+/* Frees all the blocks */
+void nlex_arena_release(NlexArena * a);
+
+/* nlex_arena_rewind() on nh->arena; everything interned is forgotten */
+void nlex_arena_reset(NlexHandle * nh);
+
+/* Releases nh->arena and frees the interning table; nlex_destroy() calls
+ * this.
+ */
+void nlex_arena_free(NlexHandle * nh);
+
+/* Hashes one more byte (c is read as unsigned char); 32-bit FNV-1a.
+ * The scanners generated with --token-hash do this as they read, and
+ * leave the hash of the token in nh->curtokhash.
+ */
+static inline size_t nlex_hash_step(size_t h, int c)
+{
+	return (uint32_t) ((h ^ (unsigned char) c) * 16777619u);
+}
+
+static inline size_t nlex_hash(const char * s, size_t len)
+{
+	size_t h = NLEX_HASH_INIT;
+
+	for(size_t i = 0; i < len; i++)
+		h = nlex_hash_step(h, s[i]);
+
+	return h;
+}
+
 static inline NlexNString
 	nlex_bufdup_info(NlexHandle * nh, size_t offset, size_t len)
 {
@@ -102,7 +203,8 @@ static inline char *
 {
 	NlexNString ns = nlex_bufdup_info(nh, offset, len);
 
-	char * newbuf = nlex_malloc(nh, ns.len + 1);
+	char * newbuf = nh->arena_dup?
+		nlex_arena_take(nh, &nh->arena, ns.len + 1): nlex_malloc(nh, ns.len + 1);
 	memcpy(newbuf, ns.buf, ns.len);
 	newbuf[ns.len] = '\0';
 	
@@ -110,14 +212,15 @@ static inline char *
 }
 
 static inline char *
-	nlex_tokdup(NlexHandle * nh, int offset, int rtrimlen)
+	nlex_tokdup(NlexHandle * nh, NlexOffset offset, NlexOffset rtrimlen)
 {
 	assert(nh->curtoklen > 0);
 
 	if( rtrimlen >= nh->curtoklen ||
 	    offset >= (nh->curtoklen - rtrimlen) )
 	{
-		char * newbuf = nlex_malloc(nh, 1);
+		char * newbuf = nh->arena_dup?
+			nlex_arena_take(nh, &nh->arena, 1): nlex_malloc(nh, 1);
 		newbuf[0] = '\0';
 
 		return newbuf;
@@ -137,17 +240,51 @@ static inline NlexNString
 		nh->curtoklen - offset - rtrimlen);
 }
 
+/* The copy of s[0..len) (nullchar-terminated, in the arena) that every
+ * call with the same bytes returns until nlex_arena_reset(); hash has to
+ * be nlex_hash(s, len). Only the first call copies.
+ */
+const char * nlex_intern_hashed(NlexHandle * nh, const char * s, size_t len, size_t hash);
+
+static inline const char * nlex_intern(NlexHandle * nh, const char * s, size_t len)
+{
+	return nlex_intern_hashed(nh, s, len, nlex_hash(s, len));
+}
+
+/* The current token interned, with the hash the scanner found as it read
+ * the token (so only for the scanners generated with --token-hash)
+ */
+static inline const char * nlex_tokintern(NlexHandle * nh)
+{
+	NlexNString ns = nlex_tokdup_info(nh, 0, 0);
+	return nlex_intern_hashed(nh, ns.buf, ns.len, nh->curtokhash);
+}
+
+/* Frees (or unmaps) nh->buf; for segmented input, the side buffer */
+void nlex_free_buf(NlexHandle * nh);
+
+/* Frees the retired blocks; see nlex_buf_reserve(); call
+ * when nothing points into them. */
+void nlex_free_retired(NlexHandle * nh);
+
 /**
  * @param free_tokbuf Usually false because you might have copied tokbuf without strcpy() or strdup()
  */
 static inline void nlex_destroy(NlexHandle * nh)
 {
-	/* nh->fp is NULL means buf was given by the user and should not be freed. */
-	if(nh->fp)
-		free(nh->buf);
+	/* Leaves the strings given to nlex_init() alone */
+	nlex_free_buf(nh);
+	nlex_free_retired(nh);
+	nlex_arena_free(nh);
+	free(nh->tokens);
+
+	if(nh->lazy_dfa_free)
+		nh->lazy_dfa_free(nh->lazy_dfa);
 
 	free(nh->tstack);
 	free(nh->nstack);
+	free(nh->tstack_index);
+	free(nh->nstack_index);
 
 	free(nh);
 }
@@ -175,9 +312,59 @@ static inline int
 
 NlexHandle * nlex_handle_new();
 
-/* Only one of fpi or buf is required, and the other can be NULL. */
+/* Only one of fpi or buf is required, and the other can be NULL. buf is
+ * read in place (only strlen() goes over it first), so it has to stay
+ * until the end; nlex_destroy() does not free it. It has no pad (see
+ * NLEX_BUF_PAD), so nlex_skip_lower() takes it a byte at a time near the
+ * end; see nlex_init_padded().
+ */
 void nlex_init(NlexHandle * nh, FILE * fpi, const char * buf);
 
+/* Like nlex_init() with a string, but the caller guarantees NLEX_BUF_PAD
+ * readable bytes after the nullchar of buf, so that the wide loads can go
+ * up to the end.
+ */
+void nlex_init_padded(NlexHandle * nh, const char * buf);
+
+/* Like nlex_init() with a string, but the string is the file, mapped
+ * read-only with the nullchar and the pad in zero pages after it; nothing
+ * is read or copied. The file must not shrink while it is mapped. Returns
+ * false (with errno set) if the file cannot be opened or mapped, or is
+ * not a regular file.
+ */
+_Bool nlex_init_mmap(NlexHandle * nh, const char * path);
+_Bool nlex_init_mmap_fd(NlexHandle * nh, int fd);
+
+/* Like nlex_init() with a file, but the input is pulled with read_fn,
+ * which writes the next bytes straight into the buffer (nh->read_ctx is
+ * ctx for it to find its state). It reports errors through nh->on_error
+ * itself.
+ */
+void nlex_init_source(NlexHandle * nh,
+	size_t (*read_fn)(NlexHandle * nh, char * dst, size_t len), void * ctx);
+
+/* Like nlex_init() with a string, but the string is the concatenation of
+ * the count segments at iov, which are read where they are: the views
+ * (nlex_tokdup_info() and the like) point into them, except for the
+ * tokens near a segment boundary, which are copied to a side buffer
+ * (and the views of those last until the next boundary is read). The
+ * array and the segments have to stay until the end; no nullchar is
+ * needed, and the ones there are part of the input.
+ */
+void nlex_init_iov(NlexHandle * nh, const NlexNString * iov, size_t count);
+
+/* nlex_init_iov() with the one segment buf[0..len): the input ends at
+ * buf + len, whatever the bytes are. For binary data, use a scanner
+ * generated with --binary (see nlex_next_byte()).
+ */
+void nlex_init_n(NlexHandle * nh, const char * buf, size_t len);
+
+/* Starts over on another input like nlex_init(), but keeps the settings
+ * (callbacks, userdata and the like) and the memory of the handle (the
+ * state stacks and the lazy DFA cache) for reuse.
+ */
+void nlex_reset(NlexHandle * nh, FILE * fpi, const char * buf);
+
 /* Look at the last-scanned character without moving the pointer */
 static inline char nlex_last(NlexHandle * nh)
 {
@@ -195,9 +382,17 @@ static inline void nlex_back(NlexHandle * nh)
 	nh->bufptr--;
 }
 
+/* Whether the input comes in blocks (from a file, a read callback or
+ * segments) instead of being in the buffer from the start
+ */
+static inline _Bool nlex_is_streamed(const NlexHandle * nh)
+{
+	return nh->fp || nh->read_fn || nh->iov;
+}
+
 static inline _Bool nlex_end_of_input(NlexHandle * nh)
 {
-	if(nh->fp)
+	if(nlex_is_streamed(nh))
 		return nh->eof_read;
 	else /* reading from string */
 		return (nh->bufptr != nh->buf - 1) && (nlex_last(nh) == 0);
@@ -220,21 +415,47 @@ static inline void nlex_nstack_dump(NlexHandle * nh)
 	fprintf(stderr, "top]\n");
 }
 
-/* Call after setting nh->nstack_top but before the actual push */
-static inline void nlex_nstack_resize_if_needed(NlexHandle * nh)
+/* Make room for the states of a scanner whose state ids are up to maxid,
+ * with at most maxlive of them live at a time (the generated code passes
+ * these); allocates only the first time for a given scanner.
+ */
+static inline void
+	nlex_reserve_states(NlexHandle * nh, NanTreeNodeId maxid, size_t maxlive)
 {
-	if(nh->nstack_top >= nh->nstack_allocsiz) {
-		nh->nstack_allocsiz += NLEX_STATESTACK_ALLOC_UNIT;
-		nh->nstack =
-			nlex_realloc(nh, nh->nstack, sizeof(NanTreeNodeId) * nh->nstack_allocsiz);
+	if(maxid > nh->states_maxid || !nh->tstack_index) {
+		size_t len = (size_t) maxid + 1;
+
+		nh->tstack_index = nlex_realloc(nh, nh->tstack_index, sizeof(size_t) * len);
+		nh->nstack_index = nlex_realloc(nh, nh->nstack_index, sizeof(size_t) * len);
+		memset(nh->tstack_index, 0, sizeof(size_t) * len);
+		memset(nh->nstack_index, 0, sizeof(size_t) * len);
+
+		nh->states_maxid = maxid;
+	}
+
+	/* +1 as the bottom is at 1 */
+	if(maxlive + 1 > nh->tstack_allocsiz) {
+		nh->tstack_allocsiz = nh->nstack_allocsiz = maxlive + 1;
+		nh->tstack = nlex_realloc(nh, nh->tstack, sizeof(NanTreeNodeId) * (maxlive + 1));
+		nh->nstack = nlex_realloc(nh, nh->nstack, sizeof(NanTreeNodeId) * (maxlive + 1));
+		nh->tstack[0] = nh->nstack[0] = 0;
 	}
 }
 
+/* Pushing a state that is already on the stack does nothing. */
 static inline void nlex_nstack_push(NlexHandle * nh, NanTreeNodeId id)
 {
-	nh->nstack_top++;
-	nlex_nstack_resize_if_needed(nh);
-	nh->nstack[nh->nstack_top] = id;
+	size_t i = nh->nstack_index[id];
+
+	assert(id <= nh->states_maxid);
+
+	if(i <= nh->nstack_top && nh->nstack[i] == id)
+		return;
+
+	assert(nh->nstack_top + 1 < nh->nstack_allocsiz);
+
+	nh->nstack[++(nh->nstack_top)] = id;
+	nh->nstack_index[id] = nh->nstack_top;
 }
 
 static inline void nlex_nstack_remove(NlexHandle * nh, NanTreeNodeId id)
@@ -247,6 +468,36 @@ static inline void nlex_nstack_remove(NlexHandle * nh, NanTreeNodeId id)
 			nh->nstack[i] = 0; // TODO better if I can remove
 }
 
+/* Drops the first n bytes of the buffer, moving the rest to the front
+ * (bufptr and curtokpos move along); nh->buf_discarded counts them. Not
+ * for mapped or segmented input, which is read-only.
+ */
+static inline void nlex_discard(NlexHandle * nh, size_t n)
+{
+	assert(!nh->buf_mapped && !nh->iov);
+	assert(n <= (size_t) (nh->bufendptr - nh->buf));
+
+	memmove(nh->buf, nh->buf + n, nh->bufendptr - nh->buf - n + NLEX_BUF_PAD);
+
+	nh->bufptr        -= n;
+	nh->bufendptr     -= n;
+	nh->curtokpos     -= n;
+	nh->buf_discarded += n;
+}
+
+/* Room for len bytes at nh->buf, plus the pad; grows geometrically. When
+ * the buffer has to move, the old block is retired instead of freed
+ * (unless stream_window is set, which moves the bytes anyway), so that
+ * the views into it (nlex_tokdup_info() and the like) stay valid.
+ */
+void nlex_buf_reserve(NlexHandle * nh, size_t len);
+
+/* Slow path of nlex_next(): reads the next block of the file to bufptr
+ * (which is at bufendptr). Returns false on EOF, having appended the
+ * nullchar and set nh->eof_read.
+ */
+_Bool nlex_refill(NlexHandle * nh);
+
 /* Behaviour:
  * On EOF, sets nh->eof_read to 1, appends the buf with nullchar, and returns EOF.
  * Subsequent calls to nlex_last(nh) will return 0 and nlex_next() will fail.
@@ -254,71 +505,92 @@ static inline void nlex_nstack_remove(NlexHandle * nh, NanTreeNodeId id)
  */
 static inline int nlex_next(NlexHandle * nh)
 {
-	_Bool  eof_read = 0;
-	size_t bytes_read;
-
 	assert(!nh->eof_read);
 
 	nh->bufptr++;
 
-	/* If fp is NULL, bufptr is assumed to be pointed to a pre-filled buffer.
-	 * This helps tokenize strings directly.
+	/* If there is no fp or read_fn, bufptr is assumed to be pointed to a pre-filled buffer.
+	 * This helps tokenize strings directly. The bound is tested first so that
+	 * strings do not pay for the look at the sources on every byte.
 	 */
-	if(nh->fp && (nh->bufptr == nh->bufendptr)) {
-		/* This is the best place to check */
-		if(feof(nh->fp)) {
-			eof_read   = 1;
-			bytes_read = 1; /* To append nullchar */
-		}
+	if((nh->bufptr == nh->bufendptr) && nlex_is_streamed(nh) && !nlex_refill(nh))
+		return EOF;
 
-		/* We have to read more */
-		size_t curlen = nh->bufendptr - nh->buf;
-		nh->buf       = nlex_realloc(nh, nh->buf, curlen + nh->buf_alloc_unit);
+	/* Now return the character */
+	return *(nh->bufptr);
+}
 
-		/* Because realloc() might have relocated the buffer */
-		nh->bufptr    = nh->buf + curlen;
+/* nlex_next() for the scanners generated with --binary: the next byte as
+ * 0 to 255, or EOF at the end of the input, which is told by the bound
+ * (not by a nullchar or a 0xFF in the input).
+ */
+static inline int nlex_next_byte(NlexHandle * nh)
+{
+	int c = nlex_next(nh);
 
-		if(!eof_read) {
-			bytes_read = fread(nh->bufptr, 1, nh->buf_alloc_unit, nh->fp);
-			if(ferror(nh->fp))
-				nh->on_error(nh, NLEX_ERR_READING);
-		}
+	/* A streamed input is at its end at the nullchar nlex_refill() appends
+	 * (the last byte buffered otherwise).
+	 */
+	if(nh->bufptr == nh->bufendptr - 1 && (!nlex_is_streamed(nh) || nh->eof_read))
+		return EOF;
 
-		/* Really important. The feof() check at the top fails to detect the end if the file size is a multiple of buf_alloc_unit and the previous read had consumed the last block, leaving nothing for this call to read. */
-		if(bytes_read == 0) {
-			eof_read   = 1;
-			bytes_read = 1; /* To fill with nullchar */
-		}
+	return (unsigned char) c;
+}
 
-		/* Really important */
-		if(bytes_read < nh->buf_alloc_unit) {
-			nh->buf    = nlex_realloc(nh, nh->buf, curlen + bytes_read);
-			nh->bufptr = nh->buf + curlen;
-		}
-		
-		/* Points to the memory location next to the last character. */
-		nh->bufendptr = nh->bufptr + bytes_read;
+/* Moves bufptr over the run of bytes 'a' to 'z' that follows it, without
+ * reading more input (the run is cut at bufendptr, past which there are
+ * at least NLEX_BUF_PAD readable bytes, if not zeros, unless
+ * nh->buf_unpadded), and returns its length. bufptr has to be at a
+ * buffered character.
+ */
+static inline size_t nlex_skip_lower(NlexHandle * nh)
+{
+	const char * p = nh->bufptr + 1;
 
+	assert(nh->bufptr >= nh->buf && nh->bufptr < nh->bufendptr);
 
-		if(eof_read) {
-			*(nh->bufptr) = '\0';
-			nh->eof_read  = 1;
-			return EOF;
+#if defined(__SSE2__) && defined(__GNUC__)
+	/* p <= bufendptr, so the pad covers every load; without it, the
+	 * loads stop 16 bytes before bufendptr and the byte loop does the
+	 * rest. Bytes above 0x7F are negative for the signed compares.
+	 */
+	const __m128i before_a = _mm_set1_epi8('a' - 1);
+	const __m128i after_z  = _mm_set1_epi8('z' + 1);
+
+	while(!nh->buf_unpadded || nh->bufendptr - p >= 16) {
+		__m128i  v = _mm_loadu_si128((const __m128i *) p);
+		__m128i  in = _mm_and_si128(
+			_mm_cmpgt_epi8(v, before_a), _mm_cmplt_epi8(v, after_z));
+		unsigned int out = ~_mm_movemask_epi8(in) & 0xFFFFu;
+
+		if(out) {
+			p += __builtin_ctz(out);
+			break;
 		}
+
+		p += 16;
+		if(p >= nh->bufendptr)
+			break;
 	}
+#endif
 
-	/* Now return the character */
-	return *(nh->bufptr);
+	while(p < nh->bufendptr && *p >= 'a' && *p <= 'z')
+		p++;
+
+	if(p > nh->bufendptr)
+		p = nh->bufendptr;
+
+	size_t n = p - (nh->bufptr + 1);
+	nh->bufptr += n;
+	return n;
 }
 
-void nlex_onerror(NlexHandle * nh, NlexErr errno);
+void nlex_onerror(NlexHandle * nh, NlexErr err);
 
+/* The stacks are sparse sets, so they need not be cleared. */
 static inline void nlex_reset_states(NlexHandle * nh)
 {
-	nh->tstack_allocsiz = 0;
 	nh->tstack_top = 0;
-
-	nh->nstack_allocsiz = 0;
 	nh->nstack_top = 0;
 
 	nh->last_accepted_state = 0;
@@ -331,35 +603,33 @@ static inline void nlex_shift(NlexHandle * nh)
 {
 	assert(nh->bufptr >= nh->buf);
 
-	size_t chars_remaining    = nh->bufendptr - nh->bufptr;
-	size_t flushed_char_count = nh->bufptr - nh->buf;
-	
-	memmove(nh->buf, nh->bufptr, chars_remaining);
-	nh->buf = nlex_realloc(nh, nh->buf, chars_remaining);
+	nlex_discard(nh, nh->bufptr - nh->buf);
+
+	size_t chars_remaining = nh->bufendptr - nh->buf;
+	nh->buf_allocsiz = chars_remaining + NLEX_BUF_PAD;
+	nh->buf = nlex_realloc(nh, nh->buf, nh->buf_allocsiz);
 	
 	nh->bufptr    = nh->buf;
 	nh->bufendptr = nh->buf + chars_remaining; /* Yes, just out of bound. */
-
-	nh->curtokpos   -= flushed_char_count;
 }
 
 static inline void nlex_swap_t_n_stacks(NlexHandle * nh)
 {
 	NanTreeNodeId * ptmp;
-	size_t          stmp;
+	size_t        * itmp;
 	size_t          ttmp;
 
 	ptmp = nh->tstack;
-	stmp = nh->tstack_allocsiz;
+	itmp = nh->tstack_index;
 	ttmp = nh->tstack_top;
 	
-	nh->tstack     = nh->nstack;
-	nh->tstack_allocsiz = nh->nstack_allocsiz;
-	nh->tstack_top = nh->nstack_top;
+	nh->tstack       = nh->nstack;
+	nh->tstack_index = nh->nstack_index;
+	nh->tstack_top   = nh->nstack_top;
 	
-	nh->nstack     = ptmp;
-	nh->nstack_top = ttmp;
-	nh->nstack_allocsiz = stmp;
+	nh->nstack       = ptmp;
+	nh->nstack_index = itmp;
+	nh->nstack_top   = ttmp;
 }
 
 static inline void nlex_tstack_dump(NlexHandle * nh)
@@ -379,32 +649,14 @@ static inline _Bool nlex_tstack_is_empty(NlexHandle * nh)
 	return (nh->tstack_top == 0);
 }
 
-/* Call after popping and setting nh->tstack_top */
-static inline void nlex_tstack_downsize_if_needed(NlexHandle * nh)
-{
-	#ifdef NLEX_STATESTACK_NO_DOWNSIZE
-	return;
-	#endif
-
-	if( (nh->tstack_allocsiz - nh->tstack_top) > NLEX_STATESTACK_ALLOC_UNIT ) {
-		nh->tstack_allocsiz -= NLEX_STATESTACK_ALLOC_UNIT;
-		nh->tstack =
-			nlex_realloc(nh, nh->tstack, sizeof(NanTreeNodeId) * nh->tstack_allocsiz);
-	}
-}
-
-/* Kept for backward compatibility */
+/* Kept for backward compatibility; the stacks keep their size now. */
 static inline void nlex_tstack_resize_if_needed(NlexHandle * nh)
 {
-	nlex_tstack_downsize_if_needed(nh);
 }
 
 static inline size_t nlex_tstack_pop(NlexHandle * nh)
 {
-	size_t id = nh->tstack[nh->tstack_top--];
-	nlex_tstack_resize_if_needed(nh);
-
-	return id;
+	return nh->tstack[nh->tstack_top--];
 }
 
 static inline void nlex_debug_print_bufptr(NlexHandle * nh, FILE * stream, size_t maxlen)
@@ -9,6 +9,8 @@
 
 #include "error.h"
 #include "fastkeywords.h"
+#include "kwhash.h"
+#include "kwsplit.h"
 #include "tree.h"
 #include "tree_types.h"
 
@@ -18,6 +20,9 @@ NanTreeNodeId treebuild_id_lastnonact = 1; /* First one used for the root */
 // TODO I hate this being a global variable
 bool zstr2deterkw = 0;
 
+bool binary_input = 0;
+bool token_hash = 0;
+
 /* Assuming the siblings are sorted/grouped; check the code before 2023-04-08
  * to see how it's handled otherwise.
  */
@@ -34,6 +39,12 @@ bool can_use_else(NanTreeNode * prvsib)
 	if(prvsib->sibling->ch < 0 && prvsib->sibling->ch != NLEX_CASE_ACT)
 		return false;
 
+	/* Likewise the other way around: the `else` would skip Node A whenever
+	 * a list before it matches.
+	 */
+	if(prvsib->ch < 0 && prvsib->ch != NLEX_CASE_ACT)
+		return false;
+
 	/* Non-special siblings might share the same character in
 	 * some cases (see tests-auto/subx-001.nlx and
 	 * tests-auto/kleene-004.nlx).
@@ -78,41 +89,19 @@ void nan_inode_to_code(NanTreeNode * node, bool pseudonode)
 
 	_Bool if_printed = 0;
 
-	for(tptr = node->first_child; tptr; tptr = tptr->sibling) {
+	/* Otherwise the action is registered where this node gets pushed
+	 * (see nan_inode_to_code_matchbranch()), not on every visit.
+	 */
+	for(tptr = node->first_child; zstr2deterkw && tptr; tptr = tptr->sibling) {
 		if(tptr->ch == NLEX_CASE_ACT) {
-			/* TODO needed only when nlex_nstack_is_empty(nh)?
-			 * why did I write so in the early days?
-			 */
-
-			if(!zstr2deterkw) {
-				fprintf(fpout,
-					"\tif(%u < hiprio_act_this_iter) {\n"
-					"\t\thiprio_act_this_iter = %u;\n",
-					nan_tree_node_id(tptr),
-					nan_tree_node_id(tptr));
-
-				fprintf(fpout, "ch_read_after_accept = 0;\n");
-			}
-			else {
-				fprintf(fpout,
-					"\tif(ch == '\\0') {\n"
-					"\t\tnh->last_accepted_state = %u;\n"
-					"\t\tlastmatchat = (nh->bufptr - nh->buf - 1);\n" /* Just to satisfy a sanity check later */
-					"\t}\n",
-					nan_tree_node_id(tptr));
-				
-				if_printed = 1;
-			}
-
-			#ifdef NLXDEBUG
 			fprintf(fpout,
-				"\tfprintf(stderr, \"set hiprio_act_this_iter = %u;\\n\");\n",
+				"\tif(ch == '\\0') {\n"
+				"\t\tnh->last_accepted_state = %u;\n"
+				"\t\tlastmatchat = (nh->bufptr - nh->buf - 1);\n" /* Just to satisfy a sanity check later */
+				"\t}\n",
 				nan_tree_node_id(tptr));
-			#endif
-			
-			if(!zstr2deterkw)
-				fprintf(fpout, "\t}\n");
 			
+			if_printed = 1;
 			break;
 		}
 	}
@@ -154,7 +143,9 @@ void nan_inode_to_code_matchbranch(NanTreeNode * tptr)
 
 	if(tptr->ch < 0) { /* Special cases */
 		if(-(tptr->ch) & NLEX_CASE_LIST) {
-			if(-(tptr->ch) & NLEX_CASE_INVERT)
+			if((-(tptr->ch) & NLEX_CASE_INVERT) && binary_input)
+				fprintf(fpout, "ch != EOF && !(");
+			else if(-(tptr->ch) & NLEX_CASE_INVERT)
 				fprintf(fpout, "ch != EOF && ch != '\\0' && !(");
 			else
 				fprintf(fpout, "(");
@@ -177,8 +168,23 @@ void nan_inode_to_code_matchbranch(NanTreeNode * tptr)
 		fprintf(fpout, "\tnh->curstate = %u;\n", nan_tree_node_id(tptr));
 	}
 	else {
-		/* Push itself onto the next-stack */
-		fprintf(fpout, "\tnlex_nstack_push(nh, %u);\n", nan_tree_node_id(tptr));
+		/* Push itself onto the next-stack, unless all it can do is accept
+		 * (which is registered right here).
+		 */
+		if(!nan_treenode_is_final(tptr))
+			fprintf(fpout, "\tnlex_nstack_push(nh, %u);\n", nan_tree_node_id(tptr));
+
+		if(tptr->acc) {
+			fprintf(fpout,
+				"\tif(%u < hiprio_act_this_iter) hiprio_act_this_iter = %u;\n",
+				tptr->acc, tptr->acc);
+
+			#ifdef NLXDEBUG
+			fprintf(fpout,
+				"\tfprintf(stderr, \"set hiprio_act_this_iter = %u;\\n\");\n",
+				tptr->acc);
+			#endif
+		}
 	}
 
 	fprintf(fpout, "}\n");
@@ -206,7 +212,8 @@ void nan_inode_to_code_kleene_skipping(NanTreeNode * node)
 	}
 }
 
-void nan_tree_astates_to_code(NanTreeNode * root, bool do_consume_callback)
+void nan_tree_astates_to_code(
+	NanTreeNode * root, const NanSplitKeywords * skw, bool do_consume_callback)
 {
 	NanTreeNode * tptr;
 
@@ -225,6 +232,8 @@ void nan_tree_astates_to_code(NanTreeNode * root, bool do_consume_callback)
 				"\t\tnh->on_consume(nh, nh->curtokpos, nh->curtoklen);\n\n");
 		}
 
+		nlg_split_keywords_to_code(skw, root, fpout);
+
 		fprintf(fpout,
 			"\t%s\n"
 			"\tbreak;\n",
@@ -234,7 +243,7 @@ void nan_tree_astates_to_code(NanTreeNode * root, bool do_consume_callback)
 	}
 
 	for(tptr = root->first_child; tptr; tptr = tptr->sibling)
-		nan_tree_astates_to_code(tptr, do_consume_callback);
+		nan_tree_astates_to_code(tptr, skw, do_consume_callback);
 }
 
 void nlg_gen_fastkw_onid(NanTreeNode * root)
@@ -292,24 +301,107 @@ void nlg_gen_fastkw_selection_trie(NanTreeNode * root)
 	nlg_gen_fastkw_onid(root);
 }
 
+/* Falls back to the trie if no perfect hash is found. */
+void nlg_gen_fastkw_selection_phash(NanTreeNode * root)
+{
+	size_t        nkeys = 0;
+	NanTreeNode * tptr;
+
+	for(tptr = root->first_child; tptr; tptr = tptr->sibling)
+		if(tptr->fastkw_pattern)
+			nkeys++;
+
+	const char ** keys    = nlex_calloc_internal(nkeys + 1, sizeof(char *));
+	const char ** actions = nlex_calloc_internal(nkeys + 1, sizeof(char *));
+
+	nkeys = 0;
+	for(tptr = root->first_child; tptr; tptr = tptr->sibling) {
+		if(tptr->fastkw_pattern) {
+			keys[nkeys]    = tptr->fastkw_pattern;
+			actions[nkeys] = nan_treenode_get_actstr(tptr);
+			nkeys++;
+		}
+	}
+
+	NanKwhash kh;
+
+	if(nan_kwhash_build(&kh, keys, nkeys)) {
+		nan_kwhash_to_code(&kh, keys, actions, "after_fastkw", fpout);
+		nan_kwhash_destruct(&kh);
+
+		nlg_gen_fastkw_onid(root);
+	}
+	else {
+		if(nkeys)
+			fprintf(stderr, "nlexgen: no perfect hash for the keywords; using the trie.\n");
+
+		nlg_gen_fastkw_selection_trie(root);
+	}
+
+	free(keys);
+	free(actions);
+}
+
+/* Value of the hex digit c; -1 if it is not one */
+static int nan_hex_digit_value(int c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	else if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	else if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+static void nan_tree_append(
+	NanTreeBuild * tb, NanTreeNode * root, NanTreeNode * node, NanTreeNode * chld)
+{
+	if(node != root || !root->first_child) {
+		nan_tree_node_append_child(node, chld);
+	}
+	else {
+		if(!tb->root_tail)
+			tb->root_tail = root->first_child;
+
+		while(tb->root_tail->sibling)
+			tb->root_tail = tb->root_tail->sibling;
+
+		tb->root_tail->sibling = chld;
+	}
+
+	if(node == root)
+		tb->root_tail = chld;
+}
+
 const char * nlg_tree_add_rule(
-	NanTreeNode * root, NlexHandle * nh_main, const char * pattern, char * action)
+	NanTreeNode * root, NanTreeBuild * tb, const char * pattern, char * action)
 {
 	if(fastkeywords_enabled && is_fastkeyword(pattern)) {
-		NanTreeNode * anode = nan_treenode_new(nh_main, NLEX_CASE_FASTKWACT);
+		NanTreeNode * anode = nan_treenode_new(&tb->nodes, NLEX_CASE_FASTKWACT);
 		nan_treenode_set_actstr(anode, action);
 		anode->fastkw_pattern = strdup(pattern);
 		assert(anode->fastkw_pattern);
 
-		nan_tree_node_append_child(root, anode);
+		nan_tree_append(tb, root, root, anode);
 
 		return NLEXERR_SUCCESS;
 	}
 
-	// TODO try if I can avoid using nlex_* for this
-	NlexHandle _nh;
-	NlexHandle * nh = &_nh; // To make refactoring smooth
-	nlex_init(nh, NULL, pattern);
+	/* One handle reads all the patterns (in place) */
+	NlexHandle * nh = tb->patnh;
+
+	if(!nh) {
+		nh = tb->patnh = nlex_handle_new();
+		if(!nh)
+			nlex_die("nlex_handle_new() returned NULL.");
+
+		nlex_init(nh, NULL, pattern);
+	}
+	else {
+		nlex_reset(nh, NULL, pattern);
+	}
 
 	NanTreeNode * tcurnode = root;
 	NanTreeNode * klndest = NULL;
@@ -334,7 +426,18 @@ const char * nlg_tree_add_rule(
 		 * But this ensures safety in case I change something.
 		 */
 
-		if(escaped) {
+		if(escaped && ch == 'x') {
+			/* \xHH, the byte HH */
+			int hi = nan_hex_digit_value(nlex_next(nh));
+			int lo = (hi < 0)? -1: nan_hex_digit_value(nlex_next(nh));
+
+			if(lo < 0)
+				return NLEXERR_UNKNOWN_ESCSEQ;
+
+			ch      = hi << 4 | lo;
+			escaped = 0;
+		}
+		else if(escaped) {
 			ch = nlex_get_counterpart(ch, escin, escout);
 			if(ch != NAN_NOMATCH)
 				escaped = 0;
@@ -353,15 +456,15 @@ const char * nlg_tree_add_rule(
 				if(in_list)
 					return NLEXERR_LIST_INSIDE_LIST;
 
-				chlist        = nan_character_list_new();
+				chlist        = nan_character_list_new(&tb->lists);
 				list_inverted = 0;
 				in_list       = 1;
 
 				goto nextiter;
 			}
 			else if(ch == '(') {
-				NanTreeNode * startnode = nan_treenode_new(nh, NLEX_CASE_PASSTHRU);
-				nan_tree_node_append_child(tcurnode, startnode);
+				NanTreeNode * startnode = nan_treenode_new(&tb->nodes, NLEX_CASE_PASSTHRU);
+				nan_tree_append(tb, root, tcurnode, startnode);
 				tcurnode = startnode;
 
 				lastsubxparent = startnode; // TODO push to a stack to support nested sub-expressions
@@ -449,7 +552,7 @@ const char * nlg_tree_add_rule(
 				 * add it as the child of curnode.
 				 */
 				
-				NanTreeNode * newnode = nlex_malloc(nh, sizeof(NanTreeNode));
+				NanTreeNode * newnode = nlex_arena_alloc(NULL, &tb->nodes, sizeof(NanTreeNode));
 				memcpy(newnode, tcurnode, sizeof(NanTreeNode));
 				newnode->first_child  = NULL;
 
@@ -465,11 +568,11 @@ const char * nlg_tree_add_rule(
 		}
 
 		if(in_list) {
-			nan_character_list_append(chlist, ch);
+			nan_character_list_append(&tb->lists, chlist, ch);
 			goto nextiter;
 		}
 
-		NanTreeNode * newnode = nan_treenode_new(nh, ch);
+		NanTreeNode * newnode = nan_treenode_new(&tb->nodes, ch);
 		
 		/* Again, no problem if chlist is invalid since
 		 * ch will not be NLEX_CASE_LIST in that case.
@@ -477,7 +580,7 @@ const char * nlg_tree_add_rule(
 		// TODO FIXME why does nan_treenode_set_charlist() fail?
 		newnode->data.chlist = chlist;
 
-		nan_tree_node_append_child(tcurnode, newnode);
+		nan_tree_append(tb, root, tcurnode, newnode);
 
 		/* For the next character, this node will be the parent */
 		tcurnode = newnode;
@@ -520,18 +623,14 @@ nextiter:
 		return NLEXERR_LIST_NOT_CLOSED;
 	
 	/* BEGIN Create/attach the action node to the tree */
-	NanTreeNode * anode = nan_treenode_new(nh_main, NLEX_CASE_ACT);
+	NanTreeNode * anode = nan_treenode_new(&tb->nodes, NLEX_CASE_ACT);
 
 	/* Copy the action. */
 	nan_treenode_set_actstr(anode, action);
 
-	nan_tree_node_append_child(tcurnode, anode);
+	nan_tree_append(tb, root, tcurnode, anode);
 	/* END Attach the action node to the tree */			
 
-	/* Last-added node is assumed to be the ID action */
-	if(fastkeywords_enabled)
-		idactnode = anode;
-
 	return NLEXERR_SUCCESS;
 }
 
@@ -606,6 +705,9 @@ void nan_tree_istates_to_code_jmp(NanTreeNode * root)
 	else
 		root->visited = true;
 
+	if(root->ch == NLEX_CASE_ACT || root->ch == NLEX_CASE_FASTKWACT)
+		return;
+
 	fputs("goto endjmp;\n", fpout);
 
 	fprintf(fpout, "jmp_%u:\n", nan_tree_node_id(root));
@@ -626,6 +728,9 @@ void nan_tree_istates_to_code_mkjmptab_rec(NanTreeNode * root, char ** jmptbl, s
 	else
 		root->visited = true;
 
+	if(root->ch == NLEX_CASE_ACT || root->ch == NLEX_CASE_FASTKWACT)
+		return;
+
 	char * lbl = nlex_malloc(NULL, 32); // TODO FIXME size
 	if(snprintf(lbl, 32, "&&jmp_%u", nan_tree_node_id(root)) >= 32)
 		nlex_die("insufficient allocation.");
@@ -641,10 +746,17 @@ void nan_tree_istates_to_code_mkjmptab_rec(NanTreeNode * root, char ** jmptbl, s
 
 Jmptab nan_tree_istates_to_code_mkjmptab(NanTreeNode * root)
 {
-	size_t tablen = (treebuild_id_lastnonact * 2) + 1;
+	NanTreeNodeId maxid = 0;
+	size_t        count = 0;
+
+	nan_tree_unvisit(root);
+	nan_tree_count_states(root, &maxid, &count);
+
+	size_t tablen = (size_t) maxid + 1;
 
 	char ** jmptbl = nlex_calloc_internal(tablen, sizeof(char *));
 
+	nan_tree_unvisit(root);
 	nan_tree_istates_to_code_mkjmptab_rec(root, jmptbl, tablen);
 	
 	return (Jmptab){ jmptbl, tablen };
@@ -667,6 +779,10 @@ void nan_tree_istates_to_code_switch(NanTreeNode * root)
 	if(root->ch == NLEX_CASE_ACT || root->ch == NLEX_CASE_FASTKWACT)
 		return;
 
+	/* Never pushed (see nan_inode_to_code_matchbranch()) */
+	if(!zstr2deterkw && nan_treenode_is_final(root))
+		return;
+
 	fprintf(fpout, "case %u: {\n", nan_tree_node_id(root));
 	nan_inode_to_code(root, false);
 
@@ -694,6 +810,219 @@ void nan_tree_number(NanTreeNode * root)
 		nan_tree_number(chld);
 }
 
+static void nan_tree_collect(
+	NanTreeNode * root, NanTreeNode *** nodes, size_t * len, size_t * allocsiz)
+{
+	if(root->visited)
+		return;
+	else
+		root->visited = true;
+
+	if(*len >= *allocsiz) {
+		*allocsiz = *allocsiz? *allocsiz * 2: 64;
+		*nodes = nlex_realloc(NULL, *nodes, sizeof(NanTreeNode *) * (*allocsiz));
+	}
+
+	(*nodes)[(*len)++] = root;
+
+	for(NanTreeNode * tptr = root->first_child; tptr; tptr = tptr->sibling)
+		nan_tree_collect(tptr, nodes, len, allocsiz);
+}
+
+void nan_tree_build_init(NanTreeBuild * tb)
+{
+	tb->nodes       = nlex_arena_default();
+	tb->lists       = nlex_arena_default();
+	tb->patnh       = NULL;
+	tb->root_tail   = NULL;
+}
+
+void nan_tree_build_free(NanTreeBuild * tb)
+{
+	nlex_arena_release(&tb->nodes);
+	nlex_arena_release(&tb->lists);
+
+	if(tb->patnh)
+		nlex_destroy(tb->patnh);
+
+	tb->patnh     = NULL;
+	tb->root_tail = NULL;
+}
+
+/* Where a node that nan_tree_flatten() moved is now; each old node points
+ * to its copy with first_child by then.
+ */
+static inline NanTreeNode * nan_tree_forward(const NanTreeNode * root, NanTreeNode * node)
+{
+	return (node && node != root)? node->first_child: node;
+}
+
+void nan_tree_flatten(NanTreeNode * root, NanTreeBuild * tb)
+{
+	NanTreeNode ** nodes = NULL;
+	size_t         len = 0;
+	size_t         allocsiz = 0;
+
+	nan_tree_unvisit(root);
+	nan_tree_collect(root, &nodes, &len, &allocsiz);
+	nan_tree_unvisit(root);
+
+	assert(len > 0 && nodes[0] == root);
+
+	/* root stays where it is; flat[i - 1] is the copy of nodes[i]. */
+	NlexArena     moved = nlex_arena_default();
+	NanTreeNode * flat  = nlex_arena_alloc(NULL, &moved, sizeof(NanTreeNode) * (len - 1));
+
+	for(size_t i = 1; i < len; i++)
+		flat[i - 1] = *nodes[i];
+
+	for(size_t i = 1; i < len; i++)
+		nodes[i]->first_child = &flat[i - 1];
+
+	for(size_t i = 0; i < len; i++) {
+		NanTreeNode * node = i? &flat[i - 1]: root;
+
+		node->first_child = nan_tree_forward(root, node->first_child);
+		node->sibling     = nan_tree_forward(root, node->sibling);
+		node->klnptr      = nan_tree_forward(root, node->klnptr);
+
+		for(int k = 0; node->klnptr_from && k < nan_tree_node_vector_get_count(node->klnptr_from); k++) {
+			nan_tree_node_vector_set_item(node->klnptr_from, k,
+				nan_tree_forward(root, nan_tree_node_vector_get_item(node->klnptr_from, k)));
+		}
+	}
+
+	free(nodes);
+	nlex_arena_release(&tb->nodes);
+	tb->nodes = moved;
+}
+
+static int nan_treenode_id_cmp(const void * a, const void * b)
+{
+	NanTreeNodeId x = (*((NanTreeNode * const *) a))->id;
+	NanTreeNodeId y = (*((NanTreeNode * const *) b))->id;
+
+	return (x > y) - (x < y);
+}
+
+void nan_tree_renumber(NanTreeNode * root)
+{
+	NanTreeNode ** nodes = NULL;
+	size_t         len = 0;
+	size_t         allocsiz = 0;
+	NanTreeNodeId  lastact = 0;
+	NanTreeNodeId  laststate = 0;
+
+	nan_tree_unvisit(root);
+	nan_tree_collect(root, &nodes, &len, &allocsiz);
+
+	/* The old ids are unique (odd and even), and their order within each
+	 * kind is what is kept.
+	 */
+	qsort(nodes, len, sizeof(NanTreeNode *), nan_treenode_id_cmp);
+
+	for(size_t i = 0; i < len; i++) {
+		if(nodes[i]->ch == NLEX_CASE_ACT)
+			nodes[i]->id = ++lastact;
+		else if(nodes[i]->ch != NLEX_CASE_FASTKWACT)
+			nodes[i]->id = ++laststate;
+	}
+
+	/* Never dispatched on; kept out of the range of the states */
+	for(size_t i = 0; i < len; i++)
+		if(nodes[i]->ch == NLEX_CASE_FASTKWACT)
+			nodes[i]->id = ++laststate;
+
+	treebuild_id_lastact    = lastact;
+	treebuild_id_lastnonact = laststate;
+
+	free(nodes);
+}
+
+static void nan_inode_mark_accept(
+	NanTreeNode * state, NanTreeNode * node, bool pseudonode);
+
+static void nan_inode_mark_accept_kleene_skipping(
+	NanTreeNode * state, NanTreeNode * node)
+{
+	for(NanTreeNode * tptr = node->first_child; tptr; tptr = tptr->sibling) {
+		if(tptr->ch == NLEX_CASE_PASSTHRU)
+			nan_inode_mark_accept_kleene_skipping(state, tptr);
+
+		if(tptr->klnptr_from) {
+			size_t len = nan_tree_node_vector_get_count(tptr->klnptr_from);
+
+			for(size_t i = 0; i < len; i++)
+				nan_inode_mark_accept(state,
+					nan_tree_node_vector_get_item(tptr->klnptr_from, i), true);
+		}
+	}
+}
+
+/* XXX Mirrors nan_inode_to_code() and nan_inode_to_code_kleene_skipping();
+ * the actions are those that the code for `state` would have seen among
+ * the children.
+ */
+static void nan_inode_mark_accept(
+	NanTreeNode * state, NanTreeNode * node, bool pseudonode)
+{
+	if(!pseudonode && node->klnptr) {
+		nan_inode_mark_accept(state, node, true);
+		return;
+	}
+
+	nan_inode_mark_accept_kleene_skipping(state, node);
+
+	for(NanTreeNode * tptr = node->first_child; tptr; tptr = tptr->sibling) {
+		if(tptr->ch == NLEX_CASE_ACT) {
+			if(state->acc == 0 || nan_tree_node_id(tptr) < state->acc)
+				state->acc = nan_tree_node_id(tptr);
+
+			break;
+		}
+	}
+}
+
+void nan_tree_mark_accepts(NanTreeNode * root)
+{
+	if(root->visited)
+		return;
+	else
+		root->visited = true;
+
+	if(root->ch == NLEX_CASE_ACT || root->ch == NLEX_CASE_FASTKWACT)
+		return;
+
+	root->acc = 0;
+	nan_inode_mark_accept(root, root, false);
+
+	for(NanTreeNode * tptr = root->first_child; tptr; tptr = tptr->sibling)
+		nan_tree_mark_accepts(tptr);
+}
+
+/* Every non-action node can be pushed (but the final ones never are; see
+ * nan_treenode_is_final()), but only once per iteration as the stacks do
+ * not keep duplicates; hence the number of such nodes bounds the states
+ * that can be live at a time.
+ */
+void nan_tree_count_states(NanTreeNode * root, NanTreeNodeId * maxid, size_t * count)
+{
+	if(root->visited)
+		return;
+	else
+		root->visited = true;
+
+	if(root->ch == NLEX_CASE_ACT || root->ch == NLEX_CASE_FASTKWACT)
+		return;
+
+	(*count)++;
+	if(nan_tree_node_id(root) > *maxid)
+		*maxid = nan_tree_node_id(root);
+
+	for(NanTreeNode * tptr = root->first_child; tptr; tptr = tptr->sibling)
+		nan_tree_count_states(tptr, maxid, count);
+}
+
 // Move futuresib to the slot before the current sibling (node->sibling)
 void nan_tree_move(NanTreeNode * node, NanTreeNode * futuresib, NanTreeNode * futuresib_prvsib)
 {
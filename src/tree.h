@@ -8,7 +8,9 @@
 #define _N96E_LEX_TREE_H
 
 #include <assert.h>
+#include <ctype.h>
 #include <stdbool.h>
+#include <string.h>
 #include "error.h"
 #include "read.h"
 #include "treebuild.h"
@@ -39,6 +41,22 @@ extern NanTreeNodeId treebuild_id_lastnonact;
 
 extern bool zstr2deterkw;
 
+/* Set by --binary: the bytes 0 and 0xFF are input like any other, and
+ * the scanner reads them as 0 to 255 with nlex_next_byte(), which gives
+ * EOF at the end of the input instead.
+ */
+extern bool binary_input;
+
+/* Set by --token-hash: the scanner hashes the bytes as it reads them (in
+ * the local tokhash) and saves the hash with each accepting state in
+ * nh->curtokhash (see nlex_hash()). NAN_HASH_STEP goes after each read,
+ * NAN_HASH_SAVE after each update of curtoklen.
+ */
+extern bool token_hash;
+
+#define NAN_HASH_STEP (token_hash? "tokhash = nlex_hash_step(tokhash, ch);\n": "")
+#define NAN_HASH_SAVE (token_hash? "nh->curtokhash = tokhash;\n": "")
+
 /* @param pseudonode True if called for node->klnstate_id_auto */
 void nan_inode_to_code(NanTreeNode * node, bool pseudonode);
 
@@ -78,10 +96,26 @@ static inline bool
 	return false;
 }
 
+/* Whether the code for the node can only accept (it has no kleene loop and
+ * no children but the action), so that pushing it would be a no-op.
+ */
+static inline bool nan_treenode_is_final(const NanTreeNode * tptr)
+{
+	if(tptr->klnptr)
+		return false;
+
+	for(const NanTreeNode * chld = tptr->first_child; chld; chld = chld->sibling)
+		if(chld->ch != NLEX_CASE_ACT)
+			return false;
+
+	return true;
+}
+
 static inline NanTreeNodeId nan_tree_node_id(NanTreeNode * node)
 {
-	/* Make the action node ids odd and others even.
-	 * This is for easy identification at runtime.
+	/* Make the action node ids odd and others even, so that both kinds
+	 * can be numbered in one pass; nan_tree_renumber() later gives each
+	 * kind its own dense range.
 	 */
 	
 	if(node->id == 0) {
@@ -111,9 +145,36 @@ static inline void
 	nan_tree_node_vector_append(klnptr->klnptr_from, node);
 }
 
-static inline NanTreeNode * nan_treenode_new(NlexHandle * nh, NlexCharacter ch)
+/* What the tree is built with: the arenas (see nlex_arena_alloc()) the
+ * nodes and the character lists come from instead of a malloc() each, the
+ * handle that reads the patterns, and the last child of the root, which
+ * gets a child per rule until the tree is simplified (appending there does
+ * not walk all of them).
+ */
+typedef struct NanTreeBuild {
+	NlexArena     nodes;
+	NlexArena     lists;
+	NlexHandle  * patnh;
+	NanTreeNode * root_tail;
+} NanTreeBuild;
+
+void nan_tree_build_init(NanTreeBuild * tb);
+
+/* Frees the nodes and the character lists of the tree, too */
+void nan_tree_build_free(NanTreeBuild * tb);
+
+/* Moves the nodes reachable from root (but root itself) into one block of
+ * tb->nodes, in depth-first order, so that the passes after the build
+ * phase walk memory in the order they visit it; the blocks they were in
+ * are freed, and the pointers in the nodes are updated. Call before
+ * anything else keeps pointers to the nodes (nlg_split_keywords() and
+ * nlg_fastkw_id_action() do).
+ */
+void nan_tree_flatten(NanTreeNode * root, NanTreeBuild * tb);
+
+static inline NanTreeNode * nan_treenode_new(NlexArena * arena, NlexCharacter ch)
 {
-	NanTreeNode * newnode = nlex_malloc(nh, sizeof(NanTreeNode));
+	NanTreeNode * newnode = nlex_arena_alloc(NULL, arena, sizeof(NanTreeNode));
 	nan_treenode_init(newnode);
 	newnode->ch = ch;
 	
@@ -153,7 +214,9 @@ static inline void
 	NlexCharacter escin;
 
 	if(c < 0) {
-		if(-c & NLEX_CASE_ANYCHAR)
+		if((-c & NLEX_CASE_ANYCHAR) && binary_input)
+			fprintf(fp, "%s != EOF", id);
+		else if(-c & NLEX_CASE_ANYCHAR)
 			fprintf(fp, "(%s != 0 && %s != EOF)", id, id);
 		else if(-c & NLEX_CASE_DIGIT)
 			fprintf(fp, "isdigit(%s)", id);
@@ -167,47 +230,59 @@ static inline void
 	else {
 		escin = nlex_get_counterpart(c, escout_c, escin_c);
 
-		if(escin == NAN_NOMATCH)
-			fprintf(fp, "%s == '%c'", id, c);
-		else
+		/* The bytes given as \xHH; ch is a char unless binary_input */
+		if(binary_input && (escin != NAN_NOMATCH || !isprint(c)))
+			fprintf(fp, "%s == %d", id, c);
+		else if(escin != NAN_NOMATCH)
 			fprintf(fp, "%s == '\\%c'", id, escin);
+		else if(!isprint(c))
+			fprintf(fp, "%s == '\\x%02x'", id, c);
+		else
+			fprintf(fp, "%s == '%c'", id, c);
 	}
 }
 
+/* The list is grown in the arena it was taken from: in place while it is
+ * the last thing in the block (as it is while its pattern is read), by a
+ * copy otherwise; the arena frees the old copies with the rest.
+ */
 static inline void
-	nan_character_list_append(NanCharacterList * ncl, NlexCharacter c)
+	nan_character_list_append(NlexArena * arena, NanCharacterList * ncl, NlexCharacter c)
 {
-	ncl->list =
-		nlex_realloc(NULL, ncl->list, sizeof(NlexCharacter) * (ncl->count + 1));
+	if(ncl->count == ncl->allocsiz) {
+		size_t more = ncl->allocsiz? ncl->allocsiz: 8;
+
+		if(ncl->list && (char *) (ncl->list + ncl->allocsiz) == arena->ptr &&
+		   sizeof(NlexCharacter) * more <= arena->left) {
+			nlex_arena_take(NULL, arena, sizeof(NlexCharacter) * more);
+		}
+		else {
+			NlexCharacter * list = nlex_arena_alloc(NULL, arena,
+				sizeof(NlexCharacter) * (ncl->allocsiz + more));
+
+			if(ncl->count)
+				memcpy(list, ncl->list, sizeof(NlexCharacter) * ncl->count);
+
+			ncl->list = list;
+		}
+
+		ncl->allocsiz += more;
+	}
 
 	ncl->list[ncl->count++] = c;
 }
 
-static inline NanCharacterList * nan_character_list_new()
+static inline NanCharacterList * nan_character_list_new(NlexArena * arena)
 {
-	NanCharacterList * ncl = nlex_malloc(NULL, sizeof(NanCharacterList));
+	NanCharacterList * ncl = nlex_arena_alloc(NULL, arena, sizeof(NanCharacterList));
 	
-	ncl->count = 0;
-	ncl->list  = NULL;
+	ncl->count    = 0;
+	ncl->allocsiz = 0;
+	ncl->list     = NULL;
 
 	return ncl;
 }
 
-static inline NanCharacterList *
-	nan_character_list_new_from_character(NlexCharacter c)
-{
-	NanCharacterList * nclist;
-
-	nclist = nan_character_list_new();
-
-	nclist->list = nlex_malloc(NULL, sizeof(NlexCharacter));
-
-	nclist->list[0] = c;
-	nclist->count   = 1;
-	
-	return nclist;
-}
-
 /* Character list to Boolean expression */
 static inline void
 	nan_character_list_to_expr(
@@ -225,18 +300,24 @@ static inline void
 	}
 }
 
-/* Conversion of action nodes */
-void nan_tree_astates_to_code(NanTreeNode * root, bool do_consume_callback);
+struct NanSplitKeywords;
+
+/* Conversion of action nodes; skw has the keywords looked up in the code
+ * of their hosts (see kwsplit.h).
+ */
+void nan_tree_astates_to_code(
+	NanTreeNode * root, const struct NanSplitKeywords * skw, bool do_consume_callback);
 
-const char * nlg_build_tree(NanTreeNode * root, NlexHandle * nh);
+const char * nlg_build_tree(NanTreeNode * root, NlexHandle * nh, NanTreeBuild * tb);
 
 void nlg_gen_fastkw_onid(NanTreeNode * root);
 
 /* XXX Duplication in treebuild.ngg */
 const char * nlg_tree_add_rule(
-	NanTreeNode * root, NlexHandle * nh, const char * pattern, char * action);
+	NanTreeNode * root, NanTreeBuild * tb, const char * pattern, char * action);
 void nlg_gen_fastkw_selection_strcmp(NanTreeNode * root);
 void nlg_gen_fastkw_selection_trie(NanTreeNode * root);
+void nlg_gen_fastkw_selection_phash(NanTreeNode * root);
 void nlg_tree_init_root(NanTreeNode * root);
 
 static inline void
@@ -266,9 +347,10 @@ static inline bool
 
 	NanCharacterList * nclist1 = NULL;
 	NanCharacterList * nclist2 = NULL;
-	
-	_Bool free1 = 0; /* Free list1 after comparison */
-	_Bool free2 = 0;
+
+	/* A single character seen as a list of one */
+	NanCharacterList single1 = { &node1->ch, 1, 1 };
+	NanCharacterList single2 = { &node2->ch, 1, 1 };
 
 	/* Four possibilities with two nodes since each can be either a
 	 * single character node or list node.
@@ -288,23 +370,15 @@ static inline bool
 	}
 
 	/* Other cases; convert to lists (when needed) and then compare. */
-	if(node1->ch < 0 && -(node1->ch) & NLEX_CASE_LIST) {
+	if(node1->ch < 0 && -(node1->ch) & NLEX_CASE_LIST)
 		nclist1 = nan_treenode_get_charlist(node1);
-		free1 = 0;
-	}
-	else {
-		nclist1 = nan_character_list_new_from_character(node1->ch);
-		free1 = 1;
-	}
+	else
+		nclist1 = &single1;
 	
-	if(node2->ch < 0 && -(node2->ch) & NLEX_CASE_LIST) {
+	if(node2->ch < 0 && -(node2->ch) & NLEX_CASE_LIST)
 		nclist2 = nan_treenode_get_charlist(node2);
-		free2 = 0;
-	}
-	else {
-		nclist2 = nan_character_list_new_from_character(node2->ch);
-		free2 = 1;
-	}
+	else
+		nclist2 = &single2;
 	
 	bool matches = true;
 
@@ -324,23 +398,6 @@ static inline bool
 		}
 	}
 	
-	/* Free the list created by this function. */
-	if(free1) {
-		free(nclist1->list);
-		free(nclist1);
-	}
-	
-	if(free2) {
-		free(nclist2->list);
-		free(nclist2);
-	}
-	
-	/* XXX For lists not created by this function,
-	 * I can free one list and reuse the pointer to the other
-	 * in case of a match to save memory.
-	 * But it has no practical advantage for a lexer.
-	 */
-	
 	return matches;
 }
 
@@ -401,7 +458,7 @@ static inline void nan_merge_treenodes(NanTreeNode * node1, NanTreeNode * node2)
 	if(node2->first_child)
 		nan_tree_node_append_child(node1, node2->first_child);
 
-	free(node2);
+	/* node2 stays where it is (in an arena or in the flattened tree). */
 }
 
 static inline void nan_merge_adjacent_siblings(NanTreeNode * node1, NanTreeNode * node2)
@@ -415,6 +472,21 @@ static inline void nan_merge_adjacent_siblings(NanTreeNode * node1, NanTreeNode
 void nan_tree_number(NanTreeNode * root);
 void nan_tree_simplify(NanTreeNode * root);
 
+/* Number the actions 1.. and the other nodes 1.. with no gaps, keeping
+ * the relative order of the ids (the priority of the actions). State ids
+ * and action ids are then separate ranges.
+ */
+void nan_tree_renumber(NanTreeNode * root);
+
+/* Sets node->acc of every state to the action its code registers, so that
+ * the NFA code does it at the push; call after nan_tree_unvisit() and
+ * after the final numbering.
+ */
+void nan_tree_mark_accepts(NanTreeNode * root);
+
+/* Bounds for nlex_reserve_states(); call after nan_tree_unvisit() */
+void nan_tree_count_states(NanTreeNode * root, NanTreeNodeId * maxid, size_t * count);
+
 static inline bool nan_treenode_has_action(NanTreeNode * root)
 {
 	NanTreeNode * chld = NULL;
@@ -11,6 +11,7 @@ void nan_character_list_destruct(NanCharacterList *this)
 
 void nan_character_list_construct(NanCharacterList *this)
 {
+	this->allocsiz = 0u;
 	this->count = 0u;
 	this->list = NULL;
 }
@@ -29,6 +30,7 @@ void nan_tree_node_construct(NanTreeNode *this)
 	this->klnptr = NULL;
 	this->fastkw_pattern = NULL;
 	this->ch = 0;
+	this->acc = 0u;
 	this->id = 0u;
 }
 
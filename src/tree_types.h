@@ -12,6 +12,7 @@ typedef struct NanTreeNodeVector NanTreeNodeVector;
 struct NanCharacterList {
 	int *list;
 	size_t count;
+	size_t allocsiz;
 };
 
 union NanTreeNodeData {
@@ -21,6 +22,7 @@ union NanTreeNodeData {
 
 struct NanTreeNode {
 	unsigned int id;
+	unsigned int acc;
 	int ch;
 	char * fastkw_pattern;
 	NanTreeNodeData data;
@@ -201,7 +201,7 @@ _ngg_tuple_nlg_get_rule nlg_get_rule(NlexHandle *nh)
 	return (_ngg_tuple_nlg_get_rule){pat, act, NLEXERR_SUCCESS};
 }
 
-const char * nlg_build_tree(NanTreeNode *root, NlexHandle *nh)
+const char * nlg_build_tree(NanTreeNode *root, NlexHandle *nh, NanTreeBuild *tb)
 {
 	nlg_tree_init_root(root);
 
@@ -229,7 +229,7 @@ const char * nlg_build_tree(NanTreeNode *root, NlexHandle *nh)
 		assert(pat); /* treebuild.ngg:102 */
 		assert(act); /* treebuild.ngg:102 */
 
-		err = nlg_tree_add_rule(root, nh, pat, act);
+		err = nlg_tree_add_rule(root, tb, pat, act);
 		if(NLEXERR_SUCCESS != err) {
 			if(pat_autodel) {
 				free(pat_autodel);
@@ -3,6 +3,7 @@
 
 typedef struct vstring vstring;
 typedef struct NanTreeNode NanTreeNode;
+typedef struct NanTreeBuild NanTreeBuild;
 typedef struct _ngg_tuple_nlg_get_rule _ngg_tuple_nlg_get_rule;
 #include <string.h>
 #include <stdlib.h>
@@ -17,7 +18,7 @@ struct vstring {
 #include "error.h"
 #include "read.h"
 const char * nlg_tree_add_rule(
-	NanTreeNode * root, NlexHandle * nh, const char * pattern, char * action);
+	NanTreeNode * root, NanTreeBuild * tb, const char * pattern, char * action);
 void nlg_tree_init_root(NanTreeNode * root);
 struct _ngg_tuple_nlg_get_rule {
 	char * m0;
@@ -34,7 +35,7 @@ const char * vstring_get(vstring *this);
 size_t vstring_get_length(vstring *this);
 void vstring_destruct(vstring *this);
 _ngg_tuple_nlg_get_rule nlg_get_rule(NlexHandle *nh);
-const char * nlg_build_tree(NanTreeNode *root, NlexHandle *nh);
+const char * nlg_build_tree(NanTreeNode *root, NlexHandle *nh, NanTreeBuild *tb);
 char unwrap_char(int ch);
 
 #endif /* _N96E_LEX_TREEBUILD_H */
@@ -7,21 +7,54 @@
 
 void nlex_handle_construct(NlexHandle *this)
 {
+	this->interned_allocsiz = 0u;
+	this->interned_count = 0u;
+	this->interned = NULL;
+	this->arena = nlex_arena_default();
+	this->lazy_dfa_free = NULL;
+	this->lazy_dfa = NULL;
+	this->tokens_next = 0u;
+	this->tokens_count = 0u;
+	this->tokens = NULL;
+	this->states_maxid = 0u;
+	this->nstack_index = NULL;
 	this->nstack_allocsiz = 0u;
 	this->nstack_top = 0u;
 	this->nstack = NULL;
+	this->tstack_index = NULL;
 	this->tstack_allocsiz = 0u;
 	this->tstack_top = 0u;
 	this->tstack = NULL;
 	this->last_accepted_state = 0u;
 	this->curstate = 0u;
 	this->eof_read = false;
+	this->curtokhash = 0u;
 	this->curtoklen = 0;
 	this->curtokpos = 0;
+	this->iov_side_allocsiz = 0u;
+	this->iov_side = NULL;
+	this->iov_off = 0u;
+	this->iov_seg = 0u;
+	this->retired_count = 0u;
+	this->retired = NULL;
+	this->buf_allocsiz = 0u;
+	this->buf_discarded = 0u;
 	this->bufendptr = NULL;
 	this->bufptr = NULL;
+	this->iov_single = nlex_n_string_default();
+	this->iov_count = 0u;
+	this->iov = NULL;
+	this->read_ctx = NULL;
+	this->read_fn = NULL;
+	this->buf_unpadded = false;
+	this->buf_given = false;
+	this->buf_mapped = 0u;
 	this->buf = NULL;
 	this->fp = NULL;
+	this->arena_dup = false;
+	this->par_min_chunk = 0u;
+	this->par_nthreads = 0u;
+	this->stream_window = 0u;
 	this->userdata = NULL;
 	this->on_consume = NULL;
 	this->on_error = NULL;
@@ -39,3 +72,30 @@ NlexNString nlex_n_string_default()
 	s.len = 0u;
 	return s;
 }
+
+NlexToken nlex_token_default()
+{
+	NlexToken s;
+	s.pos = 0u;
+	s.len = 0u;
+	s.act = 0u;
+	return s;
+}
+
+NlexInterned nlex_interned_default()
+{
+	NlexInterned s;
+	s.str = NULL;
+	s.len = 0u;
+	s.hash = 0u;
+	return s;
+}
+
+NlexArena nlex_arena_default()
+{
+	NlexArena s;
+	s.blocks = NULL;
+	s.ptr = NULL;
+	s.left = 0u;
+	return s;
+}
@@ -3,6 +3,9 @@
 
 typedef enum NlexErr NlexErr;
 typedef struct NlexNString NlexNString;
+typedef struct NlexToken NlexToken;
+typedef struct NlexInterned NlexInterned;
+typedef struct NlexArena NlexArena;
 typedef struct NlexHandle NlexHandle;
 #include <string.h>
 #include <stdlib.h>
@@ -21,30 +24,86 @@ struct NlexNString {
 };
 
 typedef unsigned int NanTreeNodeId;
+#include <stddef.h>
+typedef ptrdiff_t NlexOffset;
+struct NlexToken {
+	size_t pos;
+	size_t len;
+	NanTreeNodeId act;
+};
+
+struct NlexInterned {
+	const char * str;
+	size_t len;
+	size_t hash;
+};
+
+struct NlexArena {
+	void *blocks;
+	char * ptr;
+	size_t left;
+};
+
 struct NlexHandle {
 	size_t buf_alloc_unit;
 	void (*on_error)(NlexHandle *nh, NlexErr err);
 	void (*on_consume)(NlexHandle *nh, size_t offset, size_t len);
 	void *userdata;
+	size_t stream_window;
+	size_t par_nthreads;
+	size_t par_min_chunk;
+	_Bool arena_dup;
 	FILE * fp;
 	char * buf;
+	size_t buf_mapped;
+	_Bool buf_given;
+	_Bool buf_unpadded;
+	size_t (*read_fn)(NlexHandle *nh, char *dst, size_t len);
+	void *read_ctx;
+	NlexNString *iov;
+	size_t iov_count;
+	NlexNString iov_single;
 	char * bufptr;
 	char * bufendptr;
-	int curtokpos;
-	int curtoklen;
+	size_t buf_discarded;
+	size_t buf_allocsiz;
+	void **retired;
+	size_t retired_count;
+	size_t iov_seg;
+	size_t iov_off;
+	char * iov_side;
+	size_t iov_side_allocsiz;
+	NlexOffset curtokpos;
+	NlexOffset curtoklen;
+	size_t curtokhash;
 	_Bool eof_read;
 	unsigned int curstate;
 	unsigned int last_accepted_state;
 	unsigned int *tstack;
 	size_t tstack_top;
 	size_t tstack_allocsiz;
+	size_t *tstack_index;
 	unsigned int *nstack;
 	size_t nstack_top;
 	size_t nstack_allocsiz;
+	size_t *nstack_index;
+	unsigned int states_maxid;
+	NlexToken *tokens;
+	size_t tokens_count;
+	size_t tokens_next;
+	void *lazy_dfa;
+	void (*lazy_dfa_free)(void *p);
+	NlexArena arena;
+	NlexInterned *interned;
+	size_t interned_count;
+	size_t interned_allocsiz;
 };
 
 void nlex_handle_construct(NlexHandle *this);
 void nlex_handle_destruct(NlexHandle *this);
 NlexNString nlex_n_string_default();
+NlexToken nlex_token_default();
+NlexInterned nlex_interned_default();
+NlexArena nlex_arena_default();
 
 #endif /* _N96E_LEX_TYPES_H */
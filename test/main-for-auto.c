@@ -7,8 +7,6 @@
 
 void get_token(NlexHandle *nh);
 
-int ch;
-
 int main()
 {
 	FILE * fpout = stdout;
@@ -21,12 +19,18 @@ int main()
 	
 	nlex_init(nh, stdin, NULL);	
 
+#ifdef NLEX_TEST_PARALLEL
+	/* Tiny chunks, so that --parallel has boundaries to reconcile */
+	nh->par_nthreads  = 4;
+	nh->par_min_chunk = 2;
+#endif
+
 	do {
 		get_token(nh);
 
 		assert(nh->bufptr >= nh->buf);
 		fprintf(stderr, "bufdiff: %zu\n", (nh->bufptr - nh->buf));
-		fprintf(stderr, "eof: %d curtoklen: %d\n", nh->eof_read, nh->curtoklen);
+		fprintf(stderr, "eof: %d curtoklen: %td\n", nh->eof_read, nh->curtoklen);
 
 	} while(!nh->eof_read && nh->curtoklen > 0);
 
@@ -34,23 +34,31 @@ fi
 
 nlxopts=${NLEXFLAGS-}
 if [ "$(echo "$nlxfile"|grep fastkw)" ]; then
-	nlxopts='--fastkeywords'
+	if [ "$(echo "$nlxopts"|grep -- --fastkeywords-phash)" ]; then
+		nlxopts='--fastkeywords --fastkeywords-phash'
+	else
+		nlxopts='--fastkeywords'
+	fi
 elif [ "$(echo "$nlxfile"|grep zstr2deterkw)" ]; then
 	nlxopts='--zstr2deterkw'
 fi
 
+ccopts=''
+if [ "$(echo "$nlxopts"|grep -- --parallel)" ]; then
+	ccopts='-DNLEX_TEST_PARALLEL'
+fi
+
 echo '#include <assert.h>' > "$ocfile"
 echo '#include <ctype.h>' >> "$ocfile"
 echo '#include <read.h>' >> "$ocfile"
-echo 'extern int ch;' >> "$ocfile"
-echo 'void get_token(NlexHandle * nh) {' >> "$ocfile"
+echo '#include <lazydfa.h>' >> "$ocfile"
+echo '#include <parlex.h>' >> "$ocfile"
 # TODO timeout?
-cat "$nlxfile"|"$(dirname "$0")"/../src/nlexgen $nlxopts >> "$ocfile"
-echo '}' >> "$ocfile"
+cat "$nlxfile"|"$(dirname "$0")"/../src/nlexgen $nlxopts --function get_token >> "$ocfile"
 
 rsync "$scriptdir"'/main-for-auto.c' "$mcfile"
 
-cc -o "$elffile" -g "$mcfile" "$ocfile" "$(dirname "$0")"/../src/read.o "$(dirname "$0")"/../src/types.o -I"$(dirname "$0")"/../src
+cc $ccopts -o "$elffile" -g "$mcfile" "$ocfile" "$(dirname "$0")"/../src/read.o "$(dirname "$0")"/../src/types.o "$(dirname "$0")"/../src/lazydfa.o "$(dirname "$0")"/../src/parlex.o -pthread -I"$(dirname "$0")"/../src
 
 while IFS= read -r line; do
 echo "$line"
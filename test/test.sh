@@ -29,6 +29,30 @@ flagsarr+=('')
 flagsarr+=('--x-use-jump-table')
 flagsarr+=('--no-simplify')
 flagsarr+=('--no-simplify --x-use-jump-table')
+flagsarr+=('--dfa')
+flagsarr+=('--no-simplify --dfa')
+flagsarr+=('--dfa --no-minimize')
+flagsarr+=('--dfa-tables')
+flagsarr+=('--dfa --no-equiv-classes')
+flagsarr+=('--dfa-direct')
+flagsarr+=('--lazy-dfa')
+flagsarr+=('--dfa --dfa-max-states 2')
+flagsarr+=('--dfa-tables --dfa-max-states 3')
+flagsarr+=('--bit-parallel')
+flagsarr+=('--no-simplify --bit-parallel')
+flagsarr+=('--split-keywords')
+flagsarr+=('--split-keywords --dfa')
+flagsarr+=('--parallel')
+flagsarr+=('--parallel --resync-at-newlines')
+flagsarr+=('--binary')
+flagsarr+=('--binary --dfa-direct')
+flagsarr+=('--binary --dfa-tables --dfa-max-states 3')
+flagsarr+=('--token-hash')
+flagsarr+=('--token-hash --dfa-tables --dfa-max-states 3')
+flagsarr+=('--fastkeywords --fastkeywords-phash')
+
+# The grammars that --fastkeywords takes (an ID rule over lowercase keywords)
+fastkwtests='fastkw\|keywords-many'
 
 for flags in "${flagsarr[@]}"; do
 	while read t; do
@@ -40,6 +64,11 @@ for flags in "${flagsarr[@]}"; do
 			continue
 		fi
 		
+		if [ "$(echo "$flags"|grep -- --fastkeywords)" ] &&
+		   [ -z "$(echo "$t"|grep "$fastkwtests")" ]; then
+			continue
+		fi
+
 		title="$t (flags: $flags)"
 		echo "$title"
 		echo '===='
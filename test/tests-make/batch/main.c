@@ -0,0 +1,85 @@
+/* Lexes many small inputs with nlex_lex_batch() and checks the token
+ * counts the actions keep in the userdata of each input.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include "batch.h"
+#include "lazydfa.h"
+
+typedef struct Counts {
+	size_t ids;
+	size_t nums;
+	size_t spaces;
+} Counts;
+
+#include "count-nfa.nlexout.c"
+#include "count-lazy.nlexout.c"
+
+#define NINPUTS 20000
+
+static char           bufs[NINPUTS][64];
+static Counts         counts[NINPUTS];
+static NlexBatchInput inputs[NINPUTS];
+
+/* Input i is "ab12 " repeated (i % 7 + 1) times; every 100th one ends with
+ * a byte no rule matches.
+ */
+static size_t make_inputs(void)
+{
+	size_t nbad = 0;
+
+	for(size_t i = 0; i < NINPUTS; i++) {
+		bufs[i][0] = '\0';
+		for(size_t k = 0; k < i % 7 + 1; k++)
+			strcat(bufs[i], "ab12 ");
+
+		if(i % 100 == 0) {
+			strcat(bufs[i], "#x");
+			nbad++;
+		}
+
+		counts[i] = (Counts) { 0, 0, 0 };
+		inputs[i] = (NlexBatchInput) { bufs[i], &counts[i], 0 };
+	}
+
+	return nbad;
+}
+
+static int check(const char * name, NlexScanner scan)
+{
+	size_t nbad = make_inputs();
+	size_t incomplete = nlex_lex_batch(scan, inputs, NINPUTS, 8, NULL);
+	int    errors = 0;
+
+	if(incomplete != nbad) {
+		fprintf(stderr, "%s: %zu incomplete inputs; expected %zu\n", name, incomplete, nbad);
+		errors++;
+	}
+
+	for(size_t i = 0; i < NINPUTS; i++) {
+		size_t k = i % 7 + 1;
+
+		if(counts[i].ids != k || counts[i].nums != k || counts[i].spaces != k ||
+		   inputs[i].complete != (i % 100 != 0))
+		{
+			fprintf(stderr, "%s: wrong result for input %zu (\"%s\")\n", name, i, bufs[i]);
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+int main()
+{
+	int errors = check("nfa", scan_nfa) + check("lazy-dfa", scan_lazy);
+
+	if(errors)
+		return 1;
+
+	puts("batch: ok");
+	return 0;
+}
@@ -0,0 +1,168 @@
+/* Random bytes (many of them 0x00 and 0xFF) given with nlex_init_n(), in
+ * a block allocated to the exact length, have to lex to the tokens that
+ * a plain longest-match search over the rules finds; so does a text given
+ * as a string.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include "read.h"
+
+typedef struct Tok {
+	size_t pos;
+	size_t len;
+	int    kind;
+} Tok;
+
+typedef struct Toks {
+	Tok  * toks;
+	size_t count;
+} Toks;
+
+static void emit(NlexHandle * nh, int kind)
+{
+	Toks * t = nh->userdata;
+
+	t->toks[t->count].pos  = nh->buf_discarded + nh->curtokpos;
+	t->toks[t->count].len  = nh->curtoklen;
+	t->toks[t->count].kind = kind;
+	t->count++;
+}
+
+#include "frame-nfa.nlexout.c"
+#include "frame-direct.nlexout.c"
+#include "frame-tables.nlexout.c"
+#include "frame-fallback.nlexout.c"
+
+/* The rules of frame.nlx, tried one by one */
+static Toks reference(const unsigned char * in, size_t len)
+{
+	Toks t = { malloc(sizeof(Tok) * (len + 1)), 0 };
+
+	for(size_t pos = 0; pos < len; ) {
+		size_t m[6] = { 0 };
+		size_t n;
+
+		if(in[pos] == 0x00 && pos + 1 < len && in[pos + 1] == 0x01)
+			m[1] = 2;
+
+		for(n = 0; pos + n < len && in[pos + n] == 0xFF; n++);
+		m[2] = n;
+
+		for(n = 0; pos + n < len && in[pos + n] != 0x00 && in[pos + n] != 0xFF; n++);
+		m[3] = n;
+
+		if(in[pos] == 0x01 && pos + 1 < len)
+			m[4] = 2;
+
+		m[5] = 1;
+
+		int best = 1;
+		for(int k = 2; k <= 5; k++)
+			if(m[k] > m[best])
+				best = k;
+
+		t.toks[t.count].pos  = pos;
+		t.toks[t.count].len  = m[best];
+		t.toks[t.count].kind = best;
+		t.count++;
+
+		pos += m[best];
+	}
+
+	return t;
+}
+
+static Toks lex(NlexHandle * nh, void (*scan)(NlexHandle *), size_t len)
+{
+	Toks t = { malloc(sizeof(Tok) * (len + 1)), 0 };
+
+	nh->userdata = &t;
+
+	do {
+		scan(nh);
+	} while(!nlex_end_of_input(nh) && nh->curtoklen > 0);
+
+	return t;
+}
+
+static int compare(const char * what, const Toks * got, const Toks * expected)
+{
+	for(size_t i = 0; i < got->count && i < expected->count; i++) {
+		const Tok * g = &got->toks[i];
+		const Tok * e = &expected->toks[i];
+
+		if(g->pos != e->pos || g->len != e->len || g->kind != e->kind) {
+			fprintf(stderr, "%s: token %zu is %d at %zu (%zu bytes); expected %d at %zu (%zu bytes)\n",
+				what, i, g->kind, g->pos, g->len, e->kind, e->pos, e->len);
+			return 1;
+		}
+	}
+
+	if(got->count != expected->count) {
+		fprintf(stderr, "%s: %zu tokens; expected %zu\n", what, got->count, expected->count);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main()
+{
+	static const unsigned char alphabet[] = { 0x00, 0x01, 0xFF, 'a', 'b' };
+	static const char * names[] = { "nfa", "direct", "tables", "fallback" };
+	void (*scans[])(NlexHandle *) = { scan_nfa, scan_direct, scan_tables, scan_fallback };
+
+	int      errors = 0;
+	unsigned rnd = 1;
+
+	for(size_t len = 0; len < 20000; len = len * 3 + 1) {
+		unsigned char * in = malloc(len? len: 1);
+
+		for(size_t i = 0; i < len; i++) {
+			rnd = rnd * 1103515245 + 12345;
+			in[i] = alphabet[(rnd >> 16) % 5];
+		}
+
+		Toks expected = reference(in, len);
+
+		for(size_t i = 0; i < 4; i++) {
+			NlexHandle * nh = nlex_handle_new();
+
+			nlex_init_n(nh, (const char *) in, len);
+			Toks got = lex(nh, scans[i], len);
+			nlex_destroy(nh);
+
+			errors += compare(names[i], &got, &expected);
+			free(got.toks);
+		}
+
+		free(expected.toks);
+		free(in);
+	}
+
+	/* A string ends at its nullchar as before. */
+	const char * text = "ab\x01\x01z\x01";
+	Toks expected = reference((const unsigned char *) text, strlen(text));
+
+	for(size_t i = 0; i < 4; i++) {
+		NlexHandle * nh = nlex_handle_new();
+
+		nlex_init(nh, NULL, text);
+		Toks got = lex(nh, scans[i], strlen(text));
+		nlex_destroy(nh);
+
+		errors += compare(names[i], &got, &expected);
+		free(got.toks);
+	}
+
+	free(expected.toks);
+
+	if(errors)
+		return 1;
+
+	puts("binary: ok");
+	return 0;
+}
@@ -0,0 +1,56 @@
+/* The fixture of the tests of the input sources (mmap, source, iov and
+ * padded): the scanners generated from sum.nlx call sum_token(), which
+ * folds the kinds and the positions of the tokens into a Sum, and checks
+ * that the view of each token shows the text. The tests lex the same
+ * bytes from a string and from the source under test and compare the
+ * sums.
+ */
+
+#ifndef _N96E_LEX_TEST_SUM_H
+#define _N96E_LEX_TEST_SUM_H
+
+#include <string.h>
+
+#include "read.h"
+
+typedef struct Sum {
+	const char * text;
+	size_t       tokens;
+	size_t       hash;
+	size_t       inplace;   /* Views not in the side buffer (nlex_init_iov()) */
+	int          bad_views;
+} Sum;
+
+static void sum_token(NlexHandle * nh, size_t kind)
+{
+	Sum       * s   = nh->userdata;
+	size_t      pos = nh->buf_discarded + nh->curtokpos;
+	NlexNString ns  = nlex_tokdup_info(nh, 0, 0);
+
+	s->tokens++;
+	s->hash = s->hash * 31 + pos * 7 + (size_t) nh->curtoklen * 3 + kind;
+
+	if(ns.len != (size_t) nh->curtoklen || memcmp(ns.buf, s->text + pos, ns.len))
+		s->bad_views++;
+
+	if(nh->iov && (ns.buf < nh->iov_side || ns.buf >= nh->iov_side + nh->iov_side_allocsiz))
+		s->inplace++;
+}
+
+/* Runs scan until the input or the tokens end; text is what the input
+ * holds.
+ */
+static Sum lex(NlexHandle * nh, void (*scan)(NlexHandle *), const char * text)
+{
+	Sum s = { text, 0, 0, 0, 0 };
+
+	nh->userdata = &s;
+
+	do {
+		scan(nh);
+	} while(!nlex_end_of_input(nh) && nh->curtoklen > 0);
+
+	return s;
+}
+
+#endif
@@ -0,0 +1,167 @@
+/* Words, some of which the scanner reads past and backs off from (as in
+ * "w1-x"), are interned with the hash the scanner computed. Each word has
+ * to get the hash of its bytes, and one copy for all of its occurrences.
+ * With arena_dup, nlex_tokdup() copies have to come out right, and after
+ * nlex_arena_reset(), the words are interned anew.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include "lazydfa.h"
+
+#define MAXWORDS 1000
+
+typedef struct Words {
+	const char * text[MAXWORDS];  /* Distinct words, as first interned */
+	size_t       count;
+	size_t       tokens;
+	int          errors;
+} Words;
+
+static void word(NlexHandle * nh)
+{
+	Words     * w  = nh->userdata;
+	NlexNString ns = nlex_tokdup_info(nh, 0, 0);
+
+	w->tokens++;
+
+	if(nh->curtokhash != nlex_hash(ns.buf, ns.len)) {
+		if(w->errors++ < 5)
+			fprintf(stderr, "wrong hash for '%.*s'\n", (int) ns.len, ns.buf);
+	}
+
+	const char * s = nlex_tokintern(nh);
+
+	if(s != nlex_intern(nh, ns.buf, ns.len) || strlen(s) != ns.len || memcmp(s, ns.buf, ns.len)) {
+		w->errors++;
+		return;
+	}
+
+	char * dup = nlex_tokdup(nh, 0, 0);
+	if(strcmp(dup, s))
+		w->errors++;
+	if(!nh->arena_dup)
+		free(dup);
+
+	for(size_t i = 0; i < w->count; i++) {
+		if(0 == strcmp(w->text[i], s)) {
+			if(w->text[i] != s)
+				w->errors++;
+			return;
+		}
+	}
+
+	assert(w->count < MAXWORDS);
+	w->text[w->count++] = s;
+}
+
+#include "words-nfa.nlexout.c"
+#include "words-switch.nlexout.c"
+#include "words-direct.nlexout.c"
+#include "words-tables.nlexout.c"
+#include "words-lazy.nlexout.c"
+#include "words-bitpar.nlexout.c"
+#include "words-fallback.nlexout.c"
+#include "words-binary.nlexout.c"
+
+static void lex(NlexHandle * nh, void (*scan)(NlexHandle *), Words * w)
+{
+	nh->userdata = w;
+
+	do {
+		scan(nh);
+	} while(!nlex_end_of_input(nh) && nh->curtoklen > 0);
+}
+
+int main()
+{
+	static const char * names[] = {
+		"nfa", "switch", "direct", "tables", "lazy", "bitpar", "fallback", "binary"
+	};
+	void (*scans[])(NlexHandle *) = {
+		scan_nfa, scan_switch, scan_direct, scan_tables,
+		scan_lazy, scan_bitpar, scan_fallback, scan_binary
+	};
+	static char text[300000];
+
+	size_t   textlen = 0;
+	unsigned rnd = 1;
+	int      errors = 0;
+
+	/* 200 words, some with a digit after a dash; some dashes are followed
+	 * by a word instead
+	 */
+	while(textlen + 100 < sizeof(text)) {
+		rnd = rnd * 1103515245 + 12345;
+
+		unsigned n = (rnd >> 16) % 200;
+
+		switch((rnd >> 8) % 4) {
+		case 0:
+			textlen += sprintf(text + textlen, "w%u-%u ", n, n % 10);
+			break;
+		case 1:
+			textlen += sprintf(text + textlen, "w%u-x%u\n", n, n % 7);
+			break;
+		default:
+			textlen += sprintf(text + textlen, "w%u %u ", n, n);
+		}
+	}
+
+	Words first = { .count = 0 };
+
+	for(size_t i = 0; i < 8; i++) {
+		for(int arena_dup = 0; arena_dup <= 1; arena_dup++) {
+			NlexHandle * nh = nlex_handle_new();
+			Words        w  = { .count = 0 };
+
+			if(i == 7)
+				nlex_init_n(nh, text, textlen);
+			else
+				nlex_init(nh, NULL, text);
+
+			nh->arena_dup = arena_dup;
+			lex(nh, scans[i], &w);
+
+			if(w.count != nh->interned_count)
+				w.errors++;
+
+			if(i == 0 && !arena_dup)
+				first.count = w.count, first.tokens = w.tokens;
+			else if(w.count != first.count || w.tokens != first.tokens)
+				w.errors++;
+
+			/* Everything again, from a clean arena */
+			nlex_arena_reset(nh);
+			if(nh->interned_count || nh->arena.left != NLEX_ARENA_BLOCK)
+				w.errors++;
+
+			Words again = { .count = 0 };
+			nlex_reset(nh, NULL, text);
+			lex(nh, scans[i], &again);
+
+			if(again.count != w.count || again.errors)
+				w.errors++;
+
+			nlex_destroy(nh);
+
+			if(w.errors) {
+				fprintf(stderr, "%s, arena_dup %d: %d errors\n", names[i], arena_dup, w.errors);
+				errors++;
+			}
+		}
+	}
+
+	if(first.count < 300 || first.tokens < 30000) {
+		fprintf(stderr, "too few words (%zu) or tokens (%zu)\n", first.count, first.tokens);
+		errors++;
+	}
+
+	if(errors)
+		return 1;
+
+	puts("intern: ok");
+	return 0;
+}
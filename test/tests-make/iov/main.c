@@ -0,0 +1,118 @@
+/* The same text given as a string and cut into segments of odd sizes
+ * (each allocated on its own, so that reading past one is caught by the
+ * sanitizers) has to lex to the same tokens, and the views of the tokens
+ * have to show the text; with big segments, most of them have to point
+ * into the segments.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include "parlex.h"
+#include "sum.h"
+
+#include "sum-nfa.nlexout.c"
+#include "sum-dfa.nlexout.c"
+#include "sum-kw.nlexout.c"
+#include "sum-par.nlexout.c"
+
+int main()
+{
+	static char text[300000];
+	size_t      textlen = 0;
+	unsigned    rnd = 1;
+
+	/* Keywords, words (a few of them long) and numbers */
+	while(textlen + 1000 < sizeof(text)) {
+		static const char * words[] = { "int", "long", "lo", "integer", "x1", "42", "abc" };
+
+		rnd = rnd * 1103515245 + 12345;
+		if((rnd >> 16) % 50 == 0) {
+			for(size_t k = (rnd >> 8) % 700; k > 0; k--)
+				text[textlen++] = 'a' + k % 26;
+		}
+		else {
+			const char * w = words[(rnd >> 16) % 7];
+			memcpy(text + textlen, w, strlen(w));
+			textlen += strlen(w);
+		}
+
+		text[textlen++] = ((rnd >> 20) % 5)? ' ': '\n';
+	}
+	text[textlen] = '\0';
+
+	int errors = 0;
+
+	void (*scans[])(NlexHandle *) = { scan_nfa, scan_dfa, scan_kw, scan_par };
+	for(size_t i = 0; i < 4; i++) {
+		NlexHandle * nh = nlex_handle_new();
+
+		nlex_init(nh, NULL, text);
+		Sum expected = lex(nh, scans[i], text);
+		nlex_destroy(nh);
+
+		/* Tiny segments (empty ones too), then big ones */
+		for(size_t maxseg = 40; maxseg <= 4000; maxseg *= 100) {
+			NlexNString * segs = malloc(sizeof(NlexNString) * (textlen + 1));
+			size_t      nsegs = 0;
+
+			for(size_t pos = 0; pos < textlen; ) {
+				rnd = rnd * 1103515245 + 12345;
+
+				size_t len = (rnd >> 16) % maxseg;
+				if(len > textlen - pos)
+					len = textlen - pos;
+
+				char * seg = malloc(len? len: 1);
+				memcpy(seg, text + pos, len);
+
+				segs[nsegs].buf = seg;
+				segs[nsegs].len = len;
+				nsegs++;
+				pos += len;
+			}
+
+			nh = nlex_handle_new();
+			nlex_init_iov(nh, segs, nsegs);
+			nh->par_nthreads  = 4;
+			nh->par_min_chunk = 1000;
+			Sum got = lex(nh, scans[i], text);
+			nlex_destroy(nh);
+
+			for(size_t k = 0; k < nsegs; k++)
+				free((char *) segs[k].buf);
+			free(segs);
+
+			if(got.tokens != expected.tokens || got.hash != expected.hash) {
+				fprintf(stderr, "scanner %zu, segments < %zu: %zu tokens; expected %zu\n",
+					i, maxseg, got.tokens, expected.tokens);
+				errors++;
+			}
+
+			if(got.bad_views || expected.bad_views) {
+				fprintf(stderr, "scanner %zu, segments < %zu: %d wrong views\n",
+					i, maxseg, got.bad_views + expected.bad_views);
+				errors++;
+			}
+
+			/* The parallel scanner reads everything in first. */
+			if(maxseg > 1000 && scans[i] != scan_par && got.inplace < got.tokens * 9 / 10) {
+				fprintf(stderr, "scanner %zu: only %zu of %zu tokens in place\n",
+					i, got.inplace, got.tokens);
+				errors++;
+			}
+		}
+
+		if(expected.tokens < 10000) {
+			fprintf(stderr, "scanner %zu: too few tokens (%zu)\n", i, expected.tokens);
+			errors++;
+		}
+	}
+
+	if(errors)
+		return 1;
+
+	puts("iov: ok");
+	return 0;
+}
@@ -0,0 +1,90 @@
+/* Lexes files of a few sizes (around the page size included) mapped with
+ * nlex_init_mmap() and compares the tokens with those of the same bytes
+ * given to nlex_init() as a string.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "read.h"
+#include "sum.h"
+
+#include "sum-nfa.nlexout.c"
+#include "sum-dfa.nlexout.c"
+
+static int check(const char * name, void (*scan)(NlexHandle *), size_t size)
+{
+	char   path[] = "/tmp/nlex-mmap-XXXXXX";
+	char * text = malloc(size + 1);
+	int    fd = mkstemp(path);
+	int    errors = 0;
+
+	assert(text && fd >= 0);
+
+	/* Lines of "ab 12\n" cut at size */
+	for(size_t i = 0; i < size; i++)
+		text[i] = "ab 12\n"[i % 6];
+	text[size] = '\0';
+
+	assert(write(fd, text, size) == (ssize_t) size);
+
+	NlexHandle * nh = nlex_handle_new();
+
+	nlex_init(nh, NULL, text);
+	Sum expected = lex(nh, scan, text);
+	nlex_destroy(nh);
+
+	nh = nlex_handle_new();
+	if(!nlex_init_mmap(nh, path)) {
+		perror("nlex_init_mmap");
+		errors++;
+	}
+	else {
+		Sum got = lex(nh, scan, text);
+
+		if(got.tokens != expected.tokens || got.hash != expected.hash) {
+			fprintf(stderr, "%s: %zu bytes: %zu tokens; expected %zu\n",
+				name, size, got.tokens, expected.tokens);
+			errors++;
+		}
+
+		if(got.bad_views || expected.bad_views) {
+			fprintf(stderr, "%s: %zu bytes: %d wrong views\n",
+				name, size, got.bad_views + expected.bad_views);
+			errors++;
+		}
+	}
+	nlex_destroy(nh);
+
+	close(fd);
+	unlink(path);
+	free(text);
+
+	return errors;
+}
+
+int main()
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t sizes[] = { 0, 1, 5, page - 1, page, page + 1, 3 * page - NLEX_BUF_PAD, 1000003 };
+	int    errors = 0;
+
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		errors += check("nfa", scan_nfa, sizes[i]) + check("dfa", scan_dfa, sizes[i]);
+
+	/* Not a regular file */
+	NlexHandle * nh = nlex_handle_new();
+	if(nlex_init_mmap(nh, "/dev/null") || nlex_init_mmap(nh, "/nonexistent")) {
+		fprintf(stderr, "nlex_init_mmap() accepted what it cannot map\n");
+		errors++;
+	}
+	free(nh);
+
+	if(errors)
+		return 1;
+
+	puts("mmap: ok");
+	return 0;
+}
@@ -0,0 +1,84 @@
+/* Strings of words that end right before a page that cannot be read have
+ * to lex in place with nlex_init() (the lowercase runs near the end taken
+ * a byte at a time), and the same copied with the pad to nlex_init_padded()
+ * have to lex to the same tokens.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "read.h"
+#include "sum.h"
+
+#include "sum-nfa.nlexout.c"
+#include "sum-kw.nlexout.c"
+
+int main()
+{
+	static const char * words[] = { "int", "long", "x", "abcdefghijklmnopqrstuvwxyz" };
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	int    errors = 0;
+
+	char * pages = mmap(NULL, 2 * pagesz, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(pages != MAP_FAILED);
+	assert(0 == mprotect(pages + pagesz, pagesz, PROT_NONE));
+
+	for(size_t len = 1; len < 80; len++) {
+		/* Words and blanks, ending in a lowercase run of a few lengths */
+		char * text = pages + pagesz - len - 1;
+		char   padded[80 + NLEX_BUF_PAD];
+
+		for(size_t i = 0, w = 0; i < len; w++) {
+			for(const char * p = words[w % 4]; *p && i < len; p++)
+				text[i++] = *p;
+			if(i < len && len - i > (w % 5))
+				text[i++] = (w % 3)? ' ': '\n';
+		}
+		text[len] = '\0';
+
+		memset(padded, 0, sizeof(padded));
+		memcpy(padded, text, len + 1);
+
+		for(int k = 0; k < 2; k++) {
+			void (*scan)(NlexHandle *) = k? scan_kw: scan_nfa;
+
+			NlexHandle * nh = nlex_handle_new();
+			nlex_init(nh, NULL, text);
+			if(nh->buf != text) {
+				fprintf(stderr, "nlex_init() copied the string\n");
+				errors++;
+			}
+			Sum got = lex(nh, scan, text);
+			nlex_destroy(nh);
+
+			nh = nlex_handle_new();
+			nlex_init_padded(nh, padded);
+			Sum expected = lex(nh, scan, padded);
+			nlex_destroy(nh);
+
+			if(got.tokens != expected.tokens || got.hash != expected.hash) {
+				fprintf(stderr, "%s: %zu bytes: %zu tokens; expected %zu\n",
+					k? "kw": "nfa", len, got.tokens, expected.tokens);
+				errors++;
+			}
+
+			if(got.bad_views || expected.bad_views) {
+				fprintf(stderr, "%s: %zu bytes: %d wrong views\n",
+					k? "kw": "nfa", len, got.bad_views + expected.bad_views);
+				errors++;
+			}
+		}
+	}
+
+	munmap(pages, 2 * pagesz);
+
+	if(errors)
+		return 1;
+
+	printf("padded: ok\n");
+	return 0;
+}
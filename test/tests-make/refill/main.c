@@ -0,0 +1,105 @@
+/* Keeps a view of every token and a copy of it, and compares the two after
+ * the whole input is read. The input comes from a regular file (read in
+ * whole) and from fmemopen() in 64-byte blocks (the buffer moves many
+ * times).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include "read.h"
+
+#define NLINES 20000
+#define NTOKENS (NLINES * 6) /* "abc N xy\n" */
+
+typedef struct Kept {
+	NlexNString views[NTOKENS];
+	char      * copies[NTOKENS];
+	size_t      count;
+} Kept;
+
+static Kept kept;
+
+static void keep_token(NlexHandle * nh)
+{
+	Kept * k = nh->userdata;
+
+	if(k->count < NTOKENS) {
+		k->views[k->count]  = nlex_tokdup_info(nh, 0, 0);
+		k->copies[k->count] = nlex_tokdup(nh, 0, 0);
+	}
+
+	k->count++;
+}
+
+#include "keep.nlexout.c"
+
+static int check(const char * name, FILE * fp, size_t alloc_unit)
+{
+	NlexHandle * nh = nlex_handle_new();
+	int          errors = 0;
+
+	kept.count = 0;
+
+	nlex_init(nh, fp, NULL);
+	nh->userdata       = &kept;
+	nh->buf_alloc_unit = alloc_unit;
+
+	do {
+		scan(nh);
+	} while(!nh->eof_read && nh->curtoklen > 0);
+
+	if(kept.count != NTOKENS) {
+		fprintf(stderr, "%s: %zu tokens; expected %d\n", name, kept.count, NTOKENS);
+		errors++;
+	}
+
+	for(size_t i = 0; i < kept.count && i < NTOKENS; i++) {
+		if(kept.views[i].len != strlen(kept.copies[i]) ||
+		   memcmp(kept.views[i].buf, kept.copies[i], kept.views[i].len))
+		{
+			if(!errors)
+				fprintf(stderr, "%s: the view of token %zu changed\n", name, i);
+			errors++;
+		}
+
+		free(kept.copies[i]);
+	}
+
+	nlex_destroy(nh);
+	return errors;
+}
+
+int main()
+{
+	static char text[NLINES * 16];
+	size_t      len = 0;
+
+	for(size_t i = 0; i < NLINES; i++)
+		len += sprintf(text + len, "abc %zu xy\n", i);
+
+	FILE * fpreg = tmpfile();
+	FILE * fpmem = fmemopen(text, len, "r");
+
+	if(!fpreg || !fpmem) {
+		perror("tmpfile/fmemopen");
+		return 1;
+	}
+
+	fwrite(text, 1, len, fpreg);
+	rewind(fpreg);
+
+	int errors = check("regular file", fpreg, BUFSIZ) + check("fmemopen", fpmem, 64);
+
+	fclose(fpreg);
+	fclose(fpmem);
+
+	if(errors)
+		return 1;
+
+	puts("refill: ok");
+	return 0;
+}
@@ -0,0 +1,166 @@
+/* A text lexed with --scan-batch scanners, with arrays of a few sizes, has
+ * to give the tokens a plain longest-match search over the rules finds
+ * (but the blanks, which the rules skip), given as a string or as bytes.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+
+#include "read.h"
+
+/* The kinds as toks.nlx names them */
+enum { KW_IF = 1, KW_WHILE, IDENT, NUMBER, PUNCT };
+
+size_t scan_nfa(NlexHandle * nh, NlexToken * out, size_t cap);
+size_t scan_direct(NlexHandle * nh, NlexToken * out, size_t cap);
+size_t scan_kw(NlexHandle * nh, NlexToken * out, size_t cap);
+size_t scan_par(NlexHandle * nh, NlexToken * out, size_t cap);
+
+typedef size_t (*Scanner)(NlexHandle *, NlexToken *, size_t);
+
+typedef struct Toks {
+	NlexToken * toks;
+	size_t      count;
+} Toks;
+
+/* The rules of toks.nlx, by hand; stops where none matches */
+static Toks reference(const char * in, size_t len)
+{
+	Toks t = { malloc(sizeof(NlexToken) * (len + 1)), 0 };
+
+	for(size_t pos = 0; pos < len; ) {
+		size_t n = 0;
+		unsigned kind = 0;
+
+		if(isalpha((unsigned char) in[pos])) {
+			while(pos + n < len && (isalnum((unsigned char) in[pos + n]) || in[pos + n] == '_'))
+				n++;
+
+			if(n == 2 && 0 == memcmp(in + pos, "if", 2))
+				kind = KW_IF;
+			else if(n == 5 && 0 == memcmp(in + pos, "while", 5))
+				kind = KW_WHILE;
+			else
+				kind = IDENT;
+		}
+		else if(isdigit((unsigned char) in[pos])) {
+			while(pos + n < len && isdigit((unsigned char) in[pos + n]))
+				n++;
+			kind = NUMBER;
+		}
+		else if(strchr("=;()", in[pos])) {
+			n = 1;
+			kind = PUNCT;
+		}
+		else if(in[pos] == ' ' || in[pos] == '\n') {
+			n = 1;
+		}
+		else {
+			break;
+		}
+
+		if(kind) {
+			t.toks[t.count].pos = pos;
+			t.toks[t.count].len = n;
+			t.toks[t.count].act = kind;
+			t.count++;
+		}
+
+		pos += n;
+	}
+
+	return t;
+}
+
+static Toks lex(NlexHandle * nh, Scanner scan, size_t cap, size_t len)
+{
+	Toks t = { malloc(sizeof(NlexToken) * (len + cap)), 0 };
+	size_t n;
+
+	do {
+		n = scan(nh, t.toks + t.count, cap);
+		t.count += n;
+	} while(n == cap);
+
+	return t;
+}
+
+static int compare(const char * what, size_t cap, const Toks * got, const Toks * expected)
+{
+	for(size_t i = 0; i < got->count && i < expected->count; i++) {
+		const NlexToken * g = &got->toks[i];
+		const NlexToken * e = &expected->toks[i];
+
+		if(g->pos != e->pos || g->len != e->len || g->act != e->act) {
+			fprintf(stderr, "%s, cap %zu: token %zu is %u at %zu (%zu bytes); expected %u at %zu (%zu bytes)\n",
+				what, cap, i, g->act, g->pos, g->len, e->act, e->pos, e->len);
+			return 1;
+		}
+	}
+
+	if(got->count != expected->count) {
+		fprintf(stderr, "%s, cap %zu: %zu tokens; expected %zu\n", what, cap, got->count, expected->count);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main()
+{
+	static const char * names[] = { "nfa", "direct", "kw", "par" };
+	static Scanner      scans[] = { scan_nfa, scan_direct, scan_kw, scan_par };
+	static const char * words[] = { "if", "while", "iffy", "whilst", "x_1", "42", "=", ";", "(", ")" };
+	static char         text[200000];
+
+	size_t   textlen = 0;
+	unsigned rnd = 1;
+	int      errors = 0;
+
+	while(textlen + 100 < sizeof(text)) {
+		rnd = rnd * 1103515245 + 12345;
+
+		const char * w = words[(rnd >> 16) % 10];
+		memcpy(text + textlen, w, strlen(w));
+		textlen += strlen(w);
+
+		if((rnd >> 20) % 3)
+			text[textlen++] = ((rnd >> 24) % 5)? ' ': '\n';
+	}
+
+	/* Nothing matches the last one. */
+	strcpy(text + textlen, " if#if");
+	textlen += strlen(text + textlen);
+
+	Toks expected = reference(text, textlen);
+
+	for(size_t i = 0; i < 4; i++) {
+		for(size_t cap = 1; cap <= 1000; cap = cap * 7 + 6) {
+			for(int as_bytes = 0; as_bytes <= 1; as_bytes++) {
+				NlexHandle * nh = nlex_handle_new();
+
+				if(as_bytes)
+					nlex_init_n(nh, text, textlen);
+				else
+					nlex_init(nh, NULL, text);
+
+				nh->par_nthreads  = 4;
+				nh->par_min_chunk = 1000;
+
+				Toks got = lex(nh, scans[i], cap, textlen);
+				nlex_destroy(nh);
+
+				errors += compare(names[i], cap, &got, &expected);
+				free(got.toks);
+			}
+		}
+	}
+
+	free(expected.toks);
+
+	if(errors)
+		return 1;
+
+	puts("scanbatch: ok");
+	return 0;
+}
@@ -0,0 +1,7 @@
+#include <assert.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "parlex.h"
+
+#include "toks-nfa.nlexout.c"
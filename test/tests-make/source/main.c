@@ -0,0 +1,111 @@
+/* A read callback that decodes a tiny run-length format ("count, byte"
+ * pairs) straight into the buffer of the lexer, in blocks of varying
+ * size; the tokens have to be those of the decoded text given as a
+ * string.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include "parlex.h"
+#include "sum.h"
+
+#include "sum-nfa.nlexout.c"
+#include "sum-par.nlexout.c"
+
+typedef struct Rle {
+	const unsigned char * in;
+	size_t                inlen;
+	size_t                pos;     /* Next pair */
+	size_t                left;    /* Of the run of in[pos - 1] */
+	size_t                calls;
+} Rle;
+
+static size_t rle_read(NlexHandle * nh, char * dst, size_t len)
+{
+	Rle  * r = nh->read_ctx;
+	size_t n = 0;
+
+	/* Never more than a few bytes, to have many blocks */
+	size_t max = 1 + r->calls++ % 37;
+	if(len > max)
+		len = max;
+
+	while(n < len) {
+		if(r->left == 0) {
+			if(r->pos >= r->inlen)
+				break;
+
+			r->left = r->in[r->pos];
+			r->pos += 2;
+			continue;
+		}
+
+		dst[n++] = r->in[r->pos - 1];
+		r->left--;
+	}
+
+	return n;
+}
+
+int main()
+{
+	static unsigned char rle[40000];
+	static char          text[sizeof(rle) / 2 * 9 + 1];
+	size_t               rlelen = 0, textlen = 0;
+
+	/* Runs of letters, digits and separators */
+	for(size_t i = 0; rlelen + 2 <= sizeof(rle); i++) {
+		unsigned char count = 1 + i * 7 % 9;
+		unsigned char byte  = "ab 12\nz9 "[i % 9];
+
+		rle[rlelen++] = count;
+		rle[rlelen++] = byte;
+
+		for(unsigned char k = 0; k < count; k++)
+			text[textlen++] = byte;
+	}
+	text[textlen] = '\0';
+
+	int errors = 0;
+
+	void (*scans[])(NlexHandle *) = { scan_nfa, scan_par };
+	for(size_t i = 0; i < 2; i++) {
+		NlexHandle * nh = nlex_handle_new();
+
+		nlex_init(nh, NULL, text);
+		Sum expected = lex(nh, scans[i], text);
+		nlex_destroy(nh);
+
+		Rle r = { rle, rlelen, 0, 0, 0 };
+
+		nh = nlex_handle_new();
+		nlex_init_source(nh, rle_read, &r);
+		nh->par_nthreads  = 4;
+		nh->par_min_chunk = 1000;
+		Sum got = lex(nh, scans[i], text);
+		nlex_destroy(nh);
+
+		if(got.tokens != expected.tokens || got.hash != expected.hash) {
+			fprintf(stderr, "scanner %zu: %zu tokens; expected %zu\n", i, got.tokens, expected.tokens);
+			errors++;
+		}
+
+		if(got.bad_views || expected.bad_views) {
+			fprintf(stderr, "scanner %zu: %d wrong views\n", i, got.bad_views + expected.bad_views);
+			errors++;
+		}
+
+		if(expected.tokens < 1000) {
+			fprintf(stderr, "scanner %zu: too few tokens (%zu)\n", i, expected.tokens);
+			errors++;
+		}
+	}
+
+	if(errors)
+		return 1;
+
+	puts("source: ok");
+	return 0;
+}
@@ -0,0 +1,94 @@
+/* Lexes a few megabytes from a file with nh->stream_window set, checking
+ * that the tokens cover the input without gaps (through buf_discarded)
+ * and that the buffer stays within the window plus a refill or two.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include "read.h"
+
+#define NLINES 200000
+#define WINDOW 4096
+
+typedef struct Stats {
+	size_t tokens;
+	size_t next;     /* Input offset where the next token should start */
+	size_t maxbuf;
+	int    gaps;
+} Stats;
+
+static void count_token(NlexHandle * nh)
+{
+	Stats * st = nh->userdata;
+	size_t  bufsiz = nh->bufendptr - nh->buf;
+
+	if(nh->buf_discarded + nh->curtokpos != st->next)
+		st->gaps++;
+
+	st->next = nh->buf_discarded + nh->curtokpos + nh->curtoklen;
+	st->tokens++;
+
+	if(bufsiz > st->maxbuf)
+		st->maxbuf = bufsiz;
+}
+
+#include "count-nfa.nlexout.c"
+#include "count-dfa.nlexout.c"
+
+static int check(const char * name, void (*scan)(NlexHandle *), FILE * fp, size_t size)
+{
+	NlexHandle * nh = nlex_handle_new();
+	Stats        st = { 0, 0, 0, 0 };
+
+	rewind(fp);
+	nlex_init(nh, fp, NULL);
+	nh->userdata      = &st;
+	nh->stream_window = WINDOW;
+
+	do {
+		scan(nh);
+	} while(!nh->eof_read && nh->curtoklen > 0);
+
+	int errors = 0;
+
+	/* "abc N xy\n" is 6 tokens */
+	if(st.tokens != (size_t) NLINES * 6 || st.next != size || st.gaps) {
+		fprintf(stderr, "%s: %zu tokens up to %zu with %d gaps; expected %zu up to %zu\n",
+			name, st.tokens, st.next, st.gaps, (size_t) NLINES * 6, size);
+		errors++;
+	}
+
+	if(st.maxbuf > WINDOW + 2 * nh->buf_alloc_unit) {
+		fprintf(stderr, "%s: the buffer grew to %zu bytes\n", name, st.maxbuf);
+		errors++;
+	}
+
+	nlex_destroy(nh);
+	return errors;
+}
+
+int main()
+{
+	FILE * fp = tmpfile();
+	if(!fp) {
+		perror("tmpfile");
+		return 1;
+	}
+
+	for(size_t i = 0; i < NLINES; i++)
+		fprintf(fp, "abc %zu xy\n", i);
+
+	size_t size = ftell(fp);
+
+	int errors = check("nfa", scan_nfa, fp, size) + check("dfa", scan_dfa, fp, size);
+
+	fclose(fp);
+
+	if(errors)
+		return 1;
+
+	puts("stream: ok");
+	return 0;
+}